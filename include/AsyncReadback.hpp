@@ -0,0 +1,83 @@
+#ifndef _ASYNC_READBACK_HPP_
+#define _ASYNC_READBACK_HPP_
+
+#include <GLES2/gl2.h>
+
+#include <vector>
+
+#include "TexturePool.hpp"
+
+/**
+    Asynchronous readback through pixel pack buffers (OpenGL ES 3.0 / desktop OpenGL 3.2).
+    start() queues a glReadPixels into a buffer object & inserts a fence behind it, so the call
+    returns immediately; finish() waits for the fence, maps the buffer & copies the pixels out.
+    In between the CPU is free to upload & draw the next frames.
+
+    Buffers are addressed by index so that an owner keeping several frames in flight
+    (FramePipeline) can give each one its own. The GLES3 entry points are resolved at run time:
+    the library still only requires OpenGL ES 2, init() returns false when the context lacks
+    them and callers fall back to a synchronous glReadPixels.
+**/
+class AsyncReadback
+{
+public:
+    AsyncReadback();
+    ~AsyncReadback();
+
+    /**
+        Resolve the entry points on the current context. IPOGLES_NO_PBO=1 forces the fallback.
+        @return true if asynchronous readback is available.
+    */
+    bool init();
+
+    bool available() const { return m_map_buffer_range != NULL; }
+
+    /**
+        Queue the readback of a render target.
+        @param index the buffer to read into, created or grown on demand
+        @param target the render target to read
+        @param type the type of a channel (GL_UNSIGNED_BYTE or GL_FLOAT)
+        @return false if the readback could not be queued.
+    */
+    bool start(int index, const RenderTarget& target, GLenum type = GL_UNSIGNED_BYTE);
+
+    /**
+        @return true if the readback queued in this buffer is complete, without waiting.
+    */
+    bool poll(int index);
+
+    /**
+        Wait for the readback queued in this buffer & copy the pixels out.
+        @param index the buffer given to start()
+        @param dst the destination, must hold the size of the target given to start()
+        @return false if nothing was queued or mapping failed.
+    */
+    bool finish(int index, void* dst);
+
+    /**
+        Delete the buffers & fences. Must be called while the owning context is current.
+    */
+    void release();
+
+private:
+    typedef struct __GLsync* GLsync;
+
+    struct Buffer
+    {
+        GLuint pbo;
+        GLsizeiptr capacity; // Allocated bytes
+        GLsizeiptr size;     // Bytes of the pending readback
+        GLsync fence;
+    };
+
+    std::vector<Buffer> m_buffers;
+
+    // Resolved by init(), NULL when the context lacks them
+    void* (*m_map_buffer_range)(GLenum, GLintptr, GLsizeiptr, GLbitfield);
+    GLboolean (*m_unmap_buffer)(GLenum);
+    GLsync (*m_fence_sync)(GLenum, GLbitfield);
+    GLenum (*m_client_wait_sync)(GLsync, GLbitfield, unsigned long long);
+    void (*m_delete_sync)(GLsync);
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef _BOUNDED_QUEUE_HPP_
+#define _BOUNDED_QUEUE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/**
+    Bounded multi-producer multi-consumer lock-free queue (Dmitry Vyukov's array queue).
+    Every cell carries a sequence number telling whether it is ready to be written or read at a
+    given position, so producers & consumers only contend on a compare-and-swap of their index.
+    push() & pop() never block: they return false when the queue is full, respectively empty.
+**/
+template <typename T>
+class BoundedQueue
+{
+public:
+    /**
+        @param capacity the maximum number of queued elements, rounded up to a power of two
+    */
+    explicit BoundedQueue(size_t capacity)
+        : m_head(0), m_tail(0)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size *= 2;
+        m_mask = size - 1;
+        m_cells = std::vector<Cell>(size);
+        for (size_t i = 0 ; i < size ; ++i)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    /**
+        @param value the element to append
+        @return false if the queue is full
+    */
+    bool push(const T& value)
+    {
+        size_t position = m_tail.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = m_cells[position & m_mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            long difference = (long)sequence - (long)position;
+            if (difference == 0)
+            {
+                if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    cell.value = value;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+                return false; // The cell still holds an element from the previous lap
+            else
+                position = m_tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    /**
+        @param value a reference receiving the oldest element
+        @return false if the queue is empty
+    */
+    bool pop(T &value)
+    {
+        size_t position = m_head.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = m_cells[position & m_mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            long difference = (long)sequence - (long)(position + 1);
+            if (difference == 0)
+            {
+                if (m_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    value = cell.value;
+                    cell.sequence.store(position + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+                return false; // Nothing written at this position yet
+            else
+                position = m_head.load(std::memory_order_relaxed);
+        }
+    }
+
+    size_t capacity() const { return m_mask + 1; }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+
+        Cell() : sequence(0), value() {}
+        Cell(const Cell& other) : sequence(other.sequence.load()), value(other.value) {}
+    };
+
+    std::vector<Cell> m_cells;
+    size_t m_mask;
+    // Kept on separate cache lines, producers & consumers would otherwise keep stealing it from each other.
+    // Padding rather than alignas: C++11 operator new does not honour extended alignments.
+    char m_pad0[64];
+    std::atomic<size_t> m_head;
+    char m_pad1[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> m_tail;
+};
+
+#endif
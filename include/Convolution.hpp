@@ -0,0 +1,109 @@
+#ifndef _CONVOLUTION_HPP_
+#define _CONVOLUTION_HPP_
+
+#include <string>
+#include <vector>
+
+#include "GpuFilterContext.hpp"
+
+/**
+    How add_convolution() splits a kernel.
+    AUTO: two 1D passes when the kernel is separable, that saves fetches & the second pass does not
+          amplify the rounding of the intermediate image (e.g. blurs), one 2D pass otherwise.
+    SEPARABLE: the caller knows the kernel is separable, a kernel that is not falls back to 2D with a warning.
+    SINGLE_PASS: always one 2D pass.
+*/
+enum ConvolutionHint
+{
+    CONVOLUTION_AUTO,
+    CONVOLUTION_SEPARABLE,
+    CONVOLUTION_SINGLE_PASS
+};
+
+/**
+    One texture fetch of a generated convolution shader.
+    x & y are texel offsets from the output pixel, fractional when two neighbouring taps
+    are merged into a single bilinear fetch.
+*/
+struct ConvolutionTap
+{
+    float x, y;
+    float weight;
+};
+
+/**
+    Turn a kernel into the fetches of a shader: zero weights are dropped and, when merge is true,
+    neighbouring taps of the same sign along a row (along the column of a single column kernel)
+    are fetched together with GL_LINEAR, as gaussian_linear_taps() does.
+    @param weights the kernel, rows * cols values in row-major order (top row first)
+    @param cols the width of the kernel, odd
+    @param rows the height of the kernel, odd
+    @param merge true to merge taps, the pass must then sample with GL_LINEAR
+    @param taps the fetches (filled by this func)
+*/
+void convolution_taps(const std::vector<float>& weights, int cols, int rows, bool merge, std::vector<ConvolutionTap> &taps);
+
+/**
+    Factor a kernel into a column & a row vector, K[i][j] = column[i] * row[j].
+    A factor without negative weight is normalized to sum to 1 & applied first, so that
+    the intermediate image of a separable run stays in [0, 1] (the render targets are 8 bits).
+    @param weights the kernel, rows * cols values in row-major order
+    @param cols the width of the kernel
+    @param rows the height of the kernel
+    @param column the vertical factor (filled by this func)
+    @param row the horizontal factor (filled by this func)
+    @param row_first set to false if the vertical factor is the one to apply first
+    @return true if the kernel is separable & one of its factors has no negative weight
+*/
+bool convolution_separate(const std::vector<float>& weights, int cols, int rows,
+                          std::vector<float> &column, std::vector<float> &row, bool &row_first);
+
+/**
+    @return a GLSL float literal of the value, e.g. "1.0" or "0.333333343"
+*/
+std::string glsl_float(float value);
+
+/**
+    Generate the statements accumulating a list of taps into a vec3 named sum.
+    @param taps the fetches
+    @param position the GLSL expression of the texture coordinate the offsets apply to
+    @param indent the indentation of each statement
+    @return the GLSL statements, they need the texture sampler & a vec2 texel (1 / size) in scope
+*/
+std::string convolution_sum_source(const std::vector<ConvolutionTap>& taps, const std::string& position, const std::string& indent);
+
+/**
+    Generate the fragment shader applying a list of taps: weights are constant folded
+    (+/-1 weights need no multiply), offsets are literals & the texel size is computed once.
+    @param taps the fetches, e.g. from convolution_taps()
+    @return the GLSL source, same interface as the shaders of shader/
+*/
+std::string convolution_shader_source(const std::vector<ConvolutionTap>& taps);
+
+/**
+    Append a convolution by an arbitrary kernel to a filter chain, without writing any GLSL.
+    The kernel is centered on the output pixel and borders are clamped to edge.
+    The result is computed per channel & saturated by the 8 bits render target.
+    @param gpu the context the passes are appended to
+    @param vertex_shader_path the path to the vertex shader
+    @param weights the kernel, rows * cols values in row-major order (top row first)
+    @param cols the width of the kernel, odd
+    @param rows the height of the kernel, odd
+    @param hint how to split the kernel
+    @return true on success, false otherwise.
+*/
+bool add_convolution(GpuFilterContext& gpu, const std::string& vertex_shader_path, const std::vector<float>& weights,
+                     int cols, int rows, ConvolutionHint hint = CONVOLUTION_AUTO);
+
+/**
+    Parse a kernel given on the command line: rows separated by '/', weights by ',',
+    optionally followed by ':<divisor>', e.g. "1,2,1/2,4,2/1,2,1:16".
+    @param spec the kernel description
+    @param weights the kernel (filled by this func)
+    @param cols the width of the kernel
+    @param rows the height of the kernel
+    @return true if every row has the same number of weights & both sizes are odd
+*/
+bool parse_convolution_kernel(const std::string& spec, std::vector<float> &weights, int &cols, int &rows);
+
+#endif
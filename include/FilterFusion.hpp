@@ -0,0 +1,80 @@
+#ifndef _FILTER_FUSION_HPP_
+#define _FILTER_FUSION_HPP_
+
+#include <string>
+#include <vector>
+
+#include "GpuFilterContext.hpp"
+
+/**
+    Estimated cost of splitting a chain in two passes, in texture fetches per pixel: the intermediate
+    render target is written once & the next pass starts from cold texture caches.
+    Stages are fused as long as the fused pass fetches less than the unfused ones plus this cost.
+*/
+const int FUSION_PASS_COST = 8;
+
+enum FilterStageType
+{
+    STAGE_CONVOLUTION, // Linear stencil, applied per channel
+    STAGE_SOBEL        // shader/sobel.frag: 1 - gradient magnitude of the (r + g + b) / 3 gray level
+};
+
+/**
+    A filter chain stage whose stencil is known, so that consecutive stages can be fused.
+**/
+struct FilterStage
+{
+    FilterStageType type;
+    std::vector<float> weights; // Convolution kernel, cols * rows values row by row from the top (y - rows / 2), empty for sobel
+    int cols, rows;
+    std::string shader_path;    // Shader of the stage when it runs alone, empty for generated kernels
+};
+
+/**
+    Describe one of the shaders of shader/ as a stage (gaussian3, gaussian5 & sobel, see cpu_filters.hpp).
+    @param fragment_shader_path the path to the fragment shader
+    @param stage the stage (filled by this func)
+    @return true if the shader stencil is known, false otherwise.
+*/
+bool filter_stage_from_shader(const std::string& fragment_shader_path, FilterStage &stage);
+
+/**
+    @return a stage running a generated convolution (see add_convolution()).
+*/
+FilterStage convolution_stage(const std::vector<float>& weights, int cols, int rows);
+
+/**
+    Compose two convolutions: applying the result is the same as applying first then second.
+    @param first the kernel applied first
+    @param second the kernel applied second
+    @param kernel the composite kernel, of size (first.cols + second.cols - 1) x (first.rows + second.rows - 1) (filled by this func)
+*/
+void compose_kernels(const FilterStage& first, const FilterStage& second, FilterStage &kernel);
+
+/**
+    Generate a fragment shader running a group of stages in a single pass: convolutions, optionally
+    followed by sobel. The interior shader reads the source once through the composite kernel (sobel takes
+    both gradients through the composite kernels sobel * kernel, which share their fetches). The border
+    shader evaluates the stages one after the other, each one clamping to edge, so that the pixels close
+    to the edges match separate passes too; it is only drawn there (see GpuFilterContext::set_border_program()).
+    @param stages the stages of the group, in the order they are applied
+    @param borders true for the border shader, false for the interior one
+    @param fetches set to the number of texture fetches of a pixel of the interior shader
+    @return the GLSL source, same interface as the shaders of shader/
+*/
+std::string fused_shader_source(const std::vector<FilterStage>& stages, bool borders, int &fetches);
+
+/**
+    Append a sequence of stages to a filter chain, fusing consecutive stages into generated passes
+    whenever the estimated fetch count (FUSION_PASS_COST included) says it is cheaper.
+    A convolution is only fused into the next stage when it keeps values in [0, 1] (non negative weights
+    summing to at most 1), since the 8 bits intermediate target would otherwise saturate them.
+    Stages left alone run their own shader (or add_convolution()).
+    @param gpu the context the passes are appended to
+    @param vertex_shader_path the path to the vertex shader
+    @param stages the stages, in the order they are applied
+    @return true on success, false otherwise.
+*/
+bool add_filter_stages(GpuFilterContext& gpu, const std::string& vertex_shader_path, const std::vector<FilterStage>& stages);
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef _FRAME_PIPELINE_HPP_
+#define _FRAME_PIPELINE_HPP_
+
+#include <vector>
+
+#include "GpuFilterContext.hpp"
+#include "AsyncReadback.hpp"
+
+/**
+    Keeps several frames in flight on one GpuFilterContext for continuous streams.
+    Every frame gets its own slot (input texture & render targets, taken from the context pool)
+    used in rotation, so uploading frame N+1 never waits for the draw of frame N nor for the
+    readback of frame N-1 to release a texture: the driver is free to overlap the three.
+    On OpenGL ES 3 contexts the readback itself is asynchronous too (see AsyncReadback): each
+    frame is copied into a pixel pack buffer as soon as it is drawn and only mapped by receive().
+
+    Typical loop, results come back depth() - 1 frames later & in order:
+        if (pipeline.in_flight() == pipeline.depth()) pipeline.receive(dst, w, h);
+        pipeline.submit(src, width, height);
+    then receive() until it returns false to drain the pipeline.
+**/
+class FramePipeline
+{
+public:
+    /**
+        @param gpu an initialized context with its filter chain loaded, current on the calling thread
+        @param depth the number of frames in flight (3: upload, draw & readback overlap)
+    */
+    explicit FramePipeline(GpuFilterContext& gpu, int depth = 3);
+    ~FramePipeline();
+
+    /**
+        Upload a frame & queue its filter chain.
+        @param src the image data (tightly packed 8 bits RGB)
+        @param width the width of the image
+        @param height the height of the image
+        @return false on failure or if depth() frames are already in flight.
+    */
+    bool submit(const unsigned char* src, int width, int height);
+
+    /**
+        Upload a planar YUV frame, convert it to RGB on the GPU (see GpuFilterContext::upload_yuv())
+        & queue the filter chain on it. Received frames are RGB.
+        @param src the Y plane followed by the chroma plane(s)
+        @param width the width of the image, even
+        @param height the height of the image, even
+        @param format the plane layout
+        @return false on failure or if depth() frames are already in flight.
+    */
+    bool submit_yuv(const unsigned char* src, int width, int height, YuvFormat format);
+
+    /**
+        Read back the oldest frame in flight.
+        @param dst the destination buffer, must hold width * height * 3 bytes of that frame
+        @param width a reference receiving the width of the frame
+        @param height a reference receiving the height of the frame
+        @return false if no frame is in flight.
+    */
+    bool receive(unsigned char* dst, int &width, int &height);
+
+    /**
+        @return true if the oldest frame in flight can be received without waiting for the GPU.
+    */
+    bool ready();
+
+    /**
+        @return true if frames are read back through pixel pack buffers, false for glReadPixels.
+    */
+    bool asynchronous() const { return m_readback.available(); }
+
+    int depth() const { return (int)m_slots.size(); }
+    int in_flight() const { return (int)(m_submitted - m_received); }
+
+private:
+    struct Slot
+    {
+        RenderTarget input;
+        RenderTarget targets[2];
+        int result; // Index of the target holding the result
+        bool queued; // The result is being copied into the readback buffer of the slot
+    };
+
+    void release(Slot& slot);
+    Slot* prepare(int width, int height, bool yuv);
+    void queue(Slot& slot, int width, int height);
+
+    GpuFilterContext& m_gpu;
+    AsyncReadback m_readback;
+    std::vector<Slot> m_slots;
+    unsigned long long m_submitted, m_received;
+};
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef _GAUSSIAN_BLUR_HPP_
+#define _GAUSSIAN_BLUR_HPP_
+
+#include <string>
+#include <vector>
+
+#include "GpuFilterContext.hpp"
+
+/**
+    Maximum number of bilinear taps of one separable pass (center included).
+    Must match MAX_TAPS in shader/gaussian_separable.frag, allows a radius up to 2 * (GAUSSIAN_MAX_TAPS - 1).
+*/
+const int GAUSSIAN_MAX_TAPS = 32;
+
+/**
+    Radius used when none is given: 3 sigma covers 99.7% of the kernel.
+    @param sigma the standard deviation of the gaussian
+    @return the radius in pixels
+*/
+int gaussian_default_radius(float sigma);
+
+/**
+    Compute the taps of a 1D gaussian kernel of the given radius, merged two by two
+    so that each pair is fetched with a single bilinear sample.
+    offsets[0] is always 0 (the center tap), the other taps are applied symmetrically at +/- offsets[i].
+    @param sigma the standard deviation of the gaussian
+    @param radius the radius of the kernel in pixels
+    @param offsets the texel offsets of each tap (filled by this func)
+    @param weights the weights of each tap, normalized so that the full kernel sums to 1 (filled by this func)
+*/
+void gaussian_linear_taps(float sigma, int radius, std::vector<float> &offsets, std::vector<float> &weights);
+
+/**
+    Append a separable gaussian blur (one horizontal & one vertical pass) to a filter chain.
+    @param gpu the context the passes are appended to
+    @param vertex_shader_path the path to the vertex shader
+    @param fragment_shader_path the path to gaussian_separable.frag
+    @param sigma the standard deviation of the gaussian
+    @param radius the radius of the kernel in pixels, 0 to derive it from sigma
+    @return true on success, false otherwise.
+*/
+bool add_gaussian_blur(GpuFilterContext& gpu, const std::string& vertex_shader_path,
+                       const std::string& fragment_shader_path, float sigma, int radius = 0);
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef _GAUSSIAN_PYRAMID_HPP_
+#define _GAUSSIAN_PYRAMID_HPP_
+
+#include <string>
+#include <vector>
+
+#include "GpuFilterContext.hpp"
+
+/**
+    Multi-scale version of an image, built on the GPU from a single upload.
+    Level 0 is the uploaded image, level i + 1 is level i blurred by the filter chain of the
+    context (e.g. gaussian5.frag or add_gaussian_blur()) then downsampled to half its size,
+    rounded up like cv::pyrDown. Every level is rendered into its own render target in one
+    sequence of draws, and only the levels asked for are read back.
+
+    Typical use:
+        gpu.load_program("shader/simple.vert", "shader/gaussian5.frag");
+        GaussianPyramid pyramid(gpu);
+        pyramid.load_program("shader/simple.vert", "shader/downsample.frag");
+        pyramid.build(src, width, height, 4);
+        pyramid.read(2, dst);
+**/
+class GaussianPyramid
+{
+public:
+    /**
+        @param gpu an initialized context, its filter chain is the blur applied before each downsampling
+    */
+    explicit GaussianPyramid(GpuFilterContext& gpu);
+    ~GaussianPyramid();
+
+    /**
+        Load the downsampling shader pair.
+        @param vertex_shader_path the path to the vertex shader
+        @param fragment_shader_path the path to shader/downsample.frag
+        @return true on success, false otherwise.
+    */
+    bool load_program(const std::string& vertex_shader_path, const std::string& fragment_shader_path);
+
+    /**
+        Upload an image & render every level of its pyramid. Targets are kept from one call to the
+        next while the size does not change. The image must fit in a tile (see GpuFilterContext::tile_size()).
+        @param src the image data (tightly packed 8 bits)
+        @param width the width of the image
+        @param height the height of the image
+        @param levels the number of levels, level 0 included. Stops early once a level is 1x1.
+        @param layout the channels of the image
+        @return true on success, false otherwise.
+    */
+    bool build(const unsigned char* src, int width, int height, int levels, PixelLayout layout = PIXELS_RGB);
+
+    /**
+        Read back a level of the last built pyramid.
+        @param level the level to read, from 1 to levels() - 1 (level 0 is the source image)
+        @param dst the destination buffer, must hold level_width(level) * level_height(level) * layout_channels(layout) bytes
+        @param layout the channels to read, usually the built layout
+        @return true on success, false if the level does not exist.
+    */
+    bool read(int level, unsigned char* dst, PixelLayout layout = PIXELS_RGB);
+
+    /**
+        Build a pyramid & read back some of its levels in one call.
+        @param dst one buffer per level (dst[0] is ignored), NULL for the levels that are not needed
+        @return true on success, false otherwise.
+    */
+    bool process(const unsigned char* src, int width, int height, const std::vector<unsigned char*>& dst,
+                 PixelLayout layout = PIXELS_RGB);
+
+    /**
+        Release the render targets of the levels. Called by the destructor.
+    */
+    void release();
+
+    int levels() const { return (int)m_levels.size() + 1; }
+    int level_width(int level) const;
+    int level_height(int level) const;
+
+    /**
+        @return the render target of a level (1 to levels() - 1), for further processing on the GPU
+    */
+    const RenderTarget& level(int level) const { return m_levels[level - 1]; }
+
+private:
+    GpuFilterContext& m_gpu;
+    GLuint m_program;
+    GLint m_texture_loc, m_source_size_loc;
+
+    int m_width, m_height;
+    std::vector<RenderTarget> m_levels;  // Levels 1 to levels() - 1
+    std::vector<RenderTarget> m_scratch; // Blur ping-pong targets, two per level from 1 to levels() - 2
+};
+
+#endif
@@ -0,0 +1,301 @@
+#ifndef _GPU_FILTER_CONTEXT_HPP_
+#define _GPU_FILTER_CONTEXT_HPP_
+
+#include <GLES2/gl2.h>
+#include <EGL/egl.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "gles_utils.hpp"
+#include "quad.hpp"
+#include "TexturePool.hpp"
+#include "ProgramCache.hpp"
+
+/**
+    A linked shader program of a filter chain along with its uniform locations.
+**/
+struct FilterPass
+{
+    GLuint program;
+    GLint texture_loc, width_loc, height_loc;
+    bool linear; // Sample the source texture with GL_LINEAR instead of GL_NEAREST
+    int radius;  // Farthest texel read around the output one, the halo needed when tiling
+
+    // Optional program drawn instead of program on the pixels closer than border to the edges, 0 for none
+    GLuint border_program;
+    GLint border_texture_loc, border_width_loc, border_height_loc;
+    int border;
+};
+
+/**
+    Planar camera formats converted to RGB on the GPU (see GpuFilterContext::upload_yuv()).
+    I420: full resolution Y plane, then quarter resolution U & V planes.
+    NV12: full resolution Y plane, then quarter resolution interleaved UV plane.
+*/
+enum YuvFormat
+{
+    YUV_I420,
+    YUV_NV12
+};
+
+/**
+    Radius assumed for the passes whose kernel is unknown (i.e. not one of the shaders of shader/).
+    Callers loading a wider custom shader set FilterPass::radius themselves.
+*/
+const int DEFAULT_PASS_RADIUS = 8;
+
+/**
+    Row streaming callbacks of GpuFilterContext::process_tiled().
+    The reader fills rows [y, y + rows) of the source into dst (tightly packed, in the layout given
+    to process_tiled()), the writer receives rows [y, y + rows) of the result. Both return false to abort.
+*/
+typedef std::function<bool(int y, int rows, unsigned char* dst)> RowReader;
+typedef std::function<bool(int y, int rows, const unsigned char* src)> RowWriter;
+
+/**
+    Offscreen OpenGL ES filtering context.
+    Initializes EGL once, keeps the shader programs, the FBOs and the input texture alive
+    and reuses them across frames so that process() can be called many times in a row.
+    Passes are executed back to back by ping-ponging between two FBOs, only the last one is read back.
+**/
+class GpuFilterContext
+{
+public:
+    GpuFilterContext();
+    ~GpuFilterContext();
+
+    /**
+        Initialize EGL (display, config, pbuffer surface & context) and make the context current.
+        @return true on success, false otherwise (see stderr for details).
+    */
+    bool init();
+
+    /**
+        Compile & link the shader pair used by process(). Replaces any previously loaded pass.
+        @param vertex_shader_path the path to the vertex shader
+        @param fragment_shader_path the path to the fragment shader
+        @return true on success, false otherwise.
+    */
+    bool load_program(const std::string& vertex_shader_path, const std::string& fragment_shader_path);
+
+    /**
+        Compile & link a shader pair and append it to the filter chain.
+        Programs come from the context ProgramCache, so loading the same pair again is cheap.
+        @param vertex_shader_path the path to the vertex shader
+        @param fragment_shader_path the path to the fragment shader
+        @return the appended pass (valid until the next add_pass call) or NULL on failure.
+    */
+    FilterPass* add_pass(const std::string& vertex_shader_path, const std::string& fragment_shader_path);
+
+    /**
+        Append a pass whose fragment shader is generated at runtime (see Convolution.hpp).
+        @param vertex_shader_path the path to the vertex shader
+        @param fragment_source the GLSL source of the fragment shader
+        @param radius the farthest texel the shader reads around the output one
+        @return the appended pass (valid until the next add_pass call) or NULL on failure.
+    */
+    FilterPass* add_pass_source(const std::string& vertex_shader_path, const std::string& fragment_source, int radius);
+
+    /**
+        Give a pass a second program drawn on its borders only, the first one being drawn inside.
+        Used by fused passes (see FilterFusion.hpp) whose fast program is only valid away from the edges.
+        @param pass the pass, e.g. returned by add_pass_source()
+        @param vertex_shader_path the path to the vertex shader
+        @param fragment_source the GLSL source of the border fragment shader
+        @param border the width of the borders in pixels
+        @return true on success, false otherwise.
+    */
+    bool set_border_program(FilterPass& pass, const std::string& vertex_shader_path, const std::string& fragment_source, int border);
+
+    /**
+        Remove every pass from the filter chain.
+    */
+    void clear_passes();
+
+    /**
+        Upload an image into the input texture with glTexSubImage2D. The FBOs & texture come from the
+        context TexturePool and are only exchanged when the size, type or layout changes.
+        BGR(A) images are swizzled by the driver where it can (see layout_formats()), single channel
+        images go to a luminance texture that the filters sample as gray RGB, and 4 channels layouts
+        render into RGBA targets so that every row stays 4 bytes aligned.
+        @param src the image data (tightly packed)
+        @param width the width of the image
+        @param height the height of the image
+        @param type the type of a channel (GL_UNSIGNED_BYTE or GL_FLOAT, other layouts than RGB
+                    need GL_UNSIGNED_BYTE when the driver cannot transfer them natively)
+        @param layout the channels of the image
+        @return true on success, false otherwise.
+    */
+    bool upload(const void* src, int width, int height, GLenum type = GL_UNSIGNED_BYTE, PixelLayout layout = PIXELS_RGB);
+
+    /**
+        Load the YUV to RGB conversion used by upload_yuv() & convert_yuv().
+        @param vertex_shader_path the path to the vertex shader
+        @param fragment_shader_path the path to shader/yuv_to_rgb.frag
+        @return true on success, false otherwise.
+    */
+    bool load_yuv_program(const std::string& vertex_shader_path, const std::string& fragment_shader_path);
+
+    /**
+        Upload a planar YUV frame & convert it to RGB into the input of the chain, on the GPU.
+        Only the planes are transferred (1.5 bytes per pixel), draw() & read() then work as after upload().
+        @param src the Y plane followed by the chroma plane(s), tightly packed
+        @param width the width of the image, even
+        @param height the height of the image, even
+        @param format the plane layout
+        @return true on success, false otherwise (no conversion program loaded, odd size...).
+    */
+    bool upload_yuv(const unsigned char* src, int width, int height, YuvFormat format);
+
+    /**
+        Upload a planar YUV frame & render its RGB conversion into any target of the frame size.
+        The planes go through textures owned by the context, reused from frame to frame.
+        @param target the RGB render target receiving the frame
+        @return true on success, false otherwise.
+    */
+    bool convert_yuv(const unsigned char* src, int width, int height, YuvFormat format, const RenderTarget& target);
+
+    /**
+        Run every pass of the chain on the uploaded image. Each pass reads the previous pass
+        render texture, the last one renders into the FBO that read() transfers back.
+    */
+    void draw();
+
+    /**
+        Read back the FBO content of the last pass.
+        @param dst the destination buffer, must hold width * height * layout_channels(layout) values of the given type
+        @param type the type of a channel (GL_UNSIGNED_BYTE or GL_FLOAT)
+        @param layout the channels to read, usually the uploaded layout
+    */
+    void read(void* dst, GLenum type = GL_UNSIGNED_BYTE, PixelLayout layout = PIXELS_RGB);
+
+    /**
+        Run every pass of the chain on any texture, rendering into the given ping-pong targets
+        instead of the context ones. Used by FramePipeline to keep several frames in flight.
+        @param source the texture read by the first pass
+        @param targets two render targets of the given size, the second one is only used by chains of more than one pass
+        @param width the width of the targets
+        @param height the height of the targets
+        @return the index of the target holding the result
+    */
+    int render(GLuint source, const RenderTarget* targets, int width, int height);
+
+    /**
+        Read back a render target.
+        @param target the target to read, e.g. the one returned by render()
+        @param dst the destination buffer, must hold target.width * target.height * layout_channels(layout) values of the given type
+        @param type the type of a channel (GL_UNSIGNED_BYTE or GL_FLOAT)
+        @param layout the channels to read
+    */
+    void read(const RenderTarget& target, void* dst, GLenum type = GL_UNSIGNED_BYTE, PixelLayout layout = PIXELS_RGB);
+
+    /**
+        Filter an image: upload, draw & read back in one call.
+        Images larger than tile_size() are transparently processed with process_tiled().
+        @param src the source image (tightly packed 8 bits)
+        @param dst the destination image in the same layout, must hold width * height * layout_channels(layout) bytes
+        @param width the width of the image
+        @param height the height of the image
+        @param layout the channels of the image, e.g. PIXELS_BGR for an OpenCV image used as is
+        @return true on success, false otherwise.
+    */
+    bool process(const unsigned char* src, unsigned char* dst, int width, int height, PixelLayout layout = PIXELS_RGB);
+
+    /**
+        Filter an image of any size by tiles of at most tile_size() x tile_size() pixels.
+        Each tile is extended by halo() pixels on every side (clamped to the image), so that
+        the stitched result is identical to an untiled run. The image is streamed by bands
+        of tiles: only a band of source & result rows lives in host memory at once.
+        @param width the width of the image
+        @param height the height of the image
+        @param read_rows the callback providing source rows
+        @param write_rows the callback receiving result rows, called in increasing y order
+        @param layout the channels of the rows
+        @return true on success, false otherwise.
+    */
+    bool process_tiled(int width, int height, const RowReader& read_rows, const RowWriter& write_rows,
+                       PixelLayout layout = PIXELS_RGB);
+
+    /**
+        The largest tile the context renders at once, halo included.
+        GL_MAX_TEXTURE_SIZE & GL_MAX_VIEWPORT_DIMS by default, IPOGLES_TILE_SIZE overrides it.
+    */
+    int tile_size() const { return m_tile_size; }
+
+    /**
+        Force a smaller tile size, 0 restores the driver limit.
+    */
+    void set_tile_size(int size);
+
+    /**
+        @return the halo a tile needs for the whole chain, i.e. the sum of the pass radii.
+    */
+    int halo() const;
+
+    /**
+        Release every GL resource and tear down EGL. Called by the destructor.
+    */
+    void release();
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    size_t pass_count() const { return m_passes.size(); }
+
+    /**
+        The texture filled by upload() & the render target holding the result of draw().
+    */
+    const RenderTarget& input() const { return m_input; }
+    const RenderTarget& result() const { return m_target[m_last_target]; }
+
+    /**
+        Draw the full screen quad with any program into the bound framebuffer, for the operators built on the context.
+    */
+    void draw_quad(GLuint program) { m_quad->display(program); }
+
+    /**
+        The pool the context textures & FBOs come from, shared with the operators built on the context.
+    */
+    TexturePool& pool() { return m_pool; }
+
+    /**
+        The shader program cache of the context.
+    */
+    ProgramCache& programs() { return m_programs; }
+
+private:
+    FilterPass* append_pass(GLuint program, int radius);
+    bool resize(int width, int height, GLenum format);
+    bool ensure_targets();
+    const LayoutFormats& formats(PixelLayout layout);
+
+    EGLDisplay m_display;
+    EGLSurface m_surface;
+    EGLContext m_context;
+
+    std::vector<FilterPass> m_passes;
+    ProgramCache m_programs;
+
+    TexturePool m_pool;
+    // Ping-pong render targets, the second one is only acquired for chains of more than one pass
+    RenderTarget m_target[2];
+    RenderTarget m_input;
+    int m_last_target;
+    int m_width, m_height;
+    int m_max_tile_size, m_tile_size;
+
+    // layout_formats() of each layout, queried on first use
+    LayoutFormats m_formats[PIXELS_GRAY + 1];
+    bool m_formats_known[PIXELS_GRAY + 1];
+    std::vector<unsigned char> m_staging; // CPU conversions of the layouts the driver cannot transfer
+
+    // YUV to RGB conversion: program, uniform locations (Y, U, V samplers, interleaved, width, height) & planes
+    GLuint m_yuv_program;
+    GLint m_yuv_locations[6];
+    RenderTarget m_planes[3];
+
+    Quad* m_quad;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef _GPU_REDUCTION_HPP_
+#define _GPU_REDUCTION_HPP_
+
+#include <string>
+#include <vector>
+
+#include "GpuFilterContext.hpp"
+
+enum ReductionOp
+{
+    REDUCE_MIN,
+    REDUCE_MAX,
+    REDUCE_MEAN
+};
+
+const int HISTOGRAM_BINS = 256;
+
+/**
+    Statistics of a texture computed on the GPU, so that only a few values are read back instead of
+    the whole frame: min, max & mean reduce the texture 4x4 to 1 into smaller and smaller targets until
+    a single pixel is left, the histogram scatters one point per pixel into a 256x1 target.
+    The intermediate levels are 32 bits float when the context renders into float targets (exact
+    mean), 8 bits otherwise (each level rounds the mean to 1/255). The histogram requires float targets.
+
+    Typical use, e.g. exposure control on the uploaded camera frame:
+        GpuReduction reduction(gpu);
+        reduction.load_histogram_program("shader/histogram.vert", "shader/histogram.frag");
+        gpu.upload(frame, width, height);
+        reduction.histogram(gpu.input(), bins);
+**/
+class GpuReduction
+{
+public:
+    /**
+        @param gpu an initialized context, the targets come from its pool
+    */
+    explicit GpuReduction(GpuFilterContext& gpu);
+    ~GpuReduction();
+
+    /**
+        Load the reduction shader pair.
+        @param vertex_shader_path the path to the vertex shader
+        @param fragment_shader_path the path to shader/reduce.frag
+        @return true on success, false otherwise.
+    */
+    bool load_reduce_program(const std::string& vertex_shader_path, const std::string& fragment_shader_path);
+
+    /**
+        Load the histogram shader pair.
+        @param vertex_shader_path the path to shader/histogram.vert
+        @param fragment_shader_path the path to shader/histogram.frag
+        @return true on success, false otherwise (also when the context has no float targets).
+    */
+    bool load_histogram_program(const std::string& vertex_shader_path, const std::string& fragment_shader_path);
+
+    /**
+        Reduce every channel of a texture to its minimum, maximum or mean. Targets are kept from
+        one call to the next while the size does not change.
+        @param source the texture to reduce, e.g. GpuFilterContext::input() or result()
+        @param op the statistic
+        @param result the value of the red, green & blue channels, from 0 to 255 (filled by this func)
+        @return true on success, false otherwise.
+    */
+    bool reduce(const RenderTarget& source, ReductionOp op, float result[3]);
+
+    /**
+        Count the pixels of a texture by luma (0.299 r + 0.587 g + 0.114 b, rounded to 0 - 255).
+        Every counted pixel is a point drawn & blended into its bin, which costs much more than a texel of
+        reduce(): on a 720p frame with llvmpipe, about 180 ms at step 1 and 8 ms at step 4, against 2 ms
+        to read the whole frame back. Measure the driver at hand with bench --stats before relying on it.
+        @param source the texture to count, e.g. GpuFilterContext::input() or result()
+        @param bins the number of pixels of each luma (filled by this func)
+        @param step only every step-th pixel of every step-th row is counted, 4 is plenty for exposure control
+        @return true on success, false otherwise.
+    */
+    bool histogram(const RenderTarget& source, unsigned int bins[HISTOGRAM_BINS], int step = 4);
+
+    /**
+        Release the render targets. Called by the destructor.
+    */
+    void release();
+
+private:
+    GpuFilterContext& m_gpu;
+    GLuint m_reduce_program;
+    GLint m_texture_loc, m_source_size_loc, m_image_size_loc, m_block_loc, m_operation_loc;
+    GLuint m_histogram_program;
+    GLint m_histogram_locations[4]; // texture, width, height, step
+
+    int m_width, m_height;
+    std::vector<RenderTarget> m_levels; // Reduced 4x4 to 1 from the source size down to 1x1
+    RenderTarget m_bins;                // HISTOGRAM_BINS x 1 float counts
+};
+
+#endif
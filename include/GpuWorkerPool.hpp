@@ -0,0 +1,107 @@
+#ifndef _GPU_WORKER_POOL_HPP_
+#define _GPU_WORKER_POOL_HPP_
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "BoundedQueue.hpp"
+#include "GpuFilterContext.hpp"
+
+/**
+    A frame handed to the pool. src & dst are owned by the caller and must stay valid until
+    the frame comes back from next().
+**/
+struct GpuFrame
+{
+    unsigned long long sequence; // Submission number, frames come back in this order
+    const unsigned char* src;    // Tightly packed 8 bits RGB
+    unsigned char* dst;          // width * height * 3 bytes
+    int width, height;
+    bool ok;                     // Set by the worker, false if processing failed
+};
+
+/**
+    Pool of worker threads, each owning its own GpuFilterContext (and so its own EGL context).
+    Frames are pulled from a bounded lock-free queue and processed concurrently, results are
+    returned in submission order.
+
+    Contexts do not share their programs: uniforms are program state and every worker sets
+    its own size on each draw. The workers are set up one after the other instead, so all but
+    the first load their programs from the ProgramCache binaries.
+
+    submit() & next() are meant to be called by a single thread (or a producer thread calling
+    submit() & a consumer thread calling next()).
+**/
+class GpuWorkerPool
+{
+public:
+    /**
+        Builds the filter chain of a worker context, called on the worker thread once its context is current.
+    */
+    typedef std::function<bool(GpuFilterContext&)> Setup;
+
+    GpuWorkerPool();
+    ~GpuWorkerPool();
+
+    /**
+        Start the workers and wait for all of them to be set up.
+        @param workers the number of worker threads (and contexts)
+        @param setup the filter chain builder, called once per worker
+        @param queue_capacity the maximum number of frames waiting for a worker
+        @return true on success, false if a context could not be created or set up, or if the pool is already running.
+    */
+    bool start(unsigned workers, const Setup& setup, size_t queue_capacity = 8);
+
+    /**
+        Queue a frame. Waits while capacity() frames are in flight: their results have to be
+        collected with next() first, submitting more from the thread calling next() would block forever.
+        @return the sequence number of the frame.
+    */
+    unsigned long long submit(const unsigned char* src, unsigned char* dst, int width, int height);
+
+    /**
+        Wait for the oldest frame in flight.
+        @param frame a reference receiving the frame
+        @return false if no frame is in flight.
+    */
+    bool next(GpuFrame &frame);
+
+    /**
+        Finish the frames in flight & join the workers. Called by the destructor.
+    */
+    void stop();
+
+    unsigned worker_count() const { return (unsigned)m_threads.size(); }
+
+    /**
+        @return the maximum number of frames in flight (queued, processed or waiting for next()).
+    */
+    size_t capacity() const { return m_slots.size(); }
+
+    /**
+        @return the number of frames submitted but not collected by next() yet.
+    */
+    size_t in_flight() const { return (size_t)(m_submitted - m_consumed); }
+
+private:
+    enum SlotState { SLOT_FREE, SLOT_PENDING, SLOT_DONE };
+
+    struct Slot
+    {
+        std::atomic<int> state;
+        GpuFrame frame;
+    };
+
+    void worker_loop(const Setup& setup, std::atomic<int>* ready);
+
+    BoundedQueue<GpuFrame>* m_queue;
+    // Results, indexed by sequence modulo their count. A slot is only reused once next() consumed it.
+    std::vector<Slot> m_slots;
+    std::vector<std::thread> m_threads;
+    std::atomic<bool> m_stop;
+    std::atomic<unsigned long long> m_submitted, m_consumed;
+};
+
+#endif
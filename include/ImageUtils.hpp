@@ -1,12 +1,211 @@
 #ifndef _IMAGE_UTILS_HPP_
 #define _IMAGE_UTILS_HPP_
 
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
-#include <fstream>
-#include <sstream>
+#include <limits>
 #include <stdexcept>
 #include <string>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "TileScheduler.hpp"
+#include "pixel_conversions.hpp"
+
+/**
+    Number of elements processed by one task of the parallel conversions below.
+*/
+const size_t IMAGE_UTILS_GRAIN = 1 << 16;
+
+/**
+    A PPM (P6) or PGM (P5) image mapped in memory, see map_pnm().
+    16 bits samples (max_value > 255) are kept as in the file: big endian.
+*/
+struct PnmImage
+{
+  const unsigned char* data; // The pixels, straight in the mapping
+  uint width, height, channels, max_value;
+  size_t size;               // Size of the pixels in bytes
+  void* mapping;
+  size_t mapping_size;
+
+  PnmImage() : data(NULL), width(0), height(0), channels(0), max_value(0), size(0), mapping(NULL), mapping_size(0) {}
+  uint bytes_per_sample() const { return max_value > 255 ? 2 : 1; }
+};
+
+/**
+    Skips whitespace & comments, then parses an unsigned number of a PNM header
+    @param cursor a reference to the current position, moved past the number
+    @param end the end of the file
+    @param value a reference receiving the number
+    @return false if there is no number
+*/
+inline bool pnm_header_value(const char* &cursor, const char* end, uint &value)
+{
+  while (cursor < end && (isspace((unsigned char)*cursor) || *cursor == '#'))
+  {
+    if (*cursor == '#')
+      while (cursor < end && *cursor != '\n') ++cursor;
+    else
+      ++cursor;
+  }
+  if (cursor == end || !isdigit((unsigned char)*cursor))
+    return false;
+  unsigned long number = 0;
+  while (cursor < end && isdigit((unsigned char)*cursor) && number <= 0xFFFFFFFFul)
+    number = number * 10 + (*cursor++ - '0');
+  value = (uint)number;
+  return number <= 0xFFFFFFFFul;
+}
+
+/**
+    Maps a binary PPM (P6) or PGM (P5) file, 8 or 16 bits, without copying the pixels.
+    The pixels stay valid until unmap_pnm(), pages are read from the page cache as they are used.
+    @param file_name the file to read from
+    @param image a reference receiving the image
+    @return true on success, false otherwise (see stderr for details)
+*/
+inline bool map_pnm(const char* file_name, PnmImage &image)
+{
+  //1. Map the whole file read only
+  int fd = open(file_name, O_RDONLY);
+  if (fd < 0)
+  {
+    std::cerr << "Could not open " << file_name << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < 3)
+  {
+    std::cerr << file_name << " is not a PNM image." << std::endl;
+    close(fd);
+    return false;
+  }
+  size_t file_size = info.st_size;
+  void* mapping = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // The mapping keeps the file
+  if (mapping == MAP_FAILED)
+  {
+    std::cerr << "Could not map " << file_name << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+  madvise(mapping, file_size, MADV_SEQUENTIAL);
+
+  //2. Parse "P5|P6 <width> <height> <max value>" & a single whitespace
+  const char* begin = (const char*)mapping;
+  const char* end = begin + file_size;
+  const char* cursor = begin + 2;
+  PnmImage result;
+  result.channels = begin[1] == '6' ? 3 : 1;
+  bool valid = begin[0] == 'P' && (begin[1] == '5' || begin[1] == '6')
+               && pnm_header_value(cursor, end, result.width) && pnm_header_value(cursor, end, result.height)
+               && pnm_header_value(cursor, end, result.max_value)
+               && result.max_value > 0 && result.max_value < 65536
+               && cursor < end && isspace((unsigned char)*cursor);
+  if (valid)
+  {
+    ++cursor;
+    // A crafted header must not wrap the size around & pass the truncation check
+    size_t pixel_size = (size_t)result.channels * result.bytes_per_sample();
+    valid = result.width > 0 && result.height > 0
+            && result.height <= std::numeric_limits<size_t>::max() / result.width / pixel_size;
+    if (valid)
+    {
+      result.size = (size_t)result.width * result.height * pixel_size;
+      valid = result.size <= (size_t)(end - cursor);
+    }
+  }
+  if (!valid)
+  {
+    std::cerr << file_name << " is not a binary PPM/PGM image (P5 or P6) or is truncated." << std::endl;
+    munmap(mapping, file_size);
+    return false;
+  }
+  result.data = (const unsigned char*)cursor;
+  result.mapping = mapping;
+  result.mapping_size = file_size;
+  image = result;
+  return true;
+}
+
+/**
+    Releases an image mapped by map_pnm()
+*/
+inline void unmap_pnm(PnmImage &image)
+{
+  if (image.mapping)
+    munmap(image.mapping, image.mapping_size);
+  image = PnmImage();
+}
+
+/**
+    Writes a binary PPM (3 channels) or PGM (1 channel) file with a single writev() of the header & the pixels
+    @param file_name the file to write in
+    @param data the pixels, 16 bits samples (max_value > 255) must be big endian
+    @param width the width of the image.
+    @param height the height of the image.
+    @param channels 1 or 3
+    @param max_value the maximum sample value, up to 65535
+    @return true on success, false otherwise (see stderr for details)
+*/
+inline bool write_pnm(const char* file_name, const unsigned char* data, uint width, uint height, uint channels, uint max_value = 255)
+{
+  if ((channels != 1 && channels != 3) || max_value == 0 || max_value > 65535)
+  {
+    std::cerr << "Cannot write a PNM image with " << channels << " channels & max value " << max_value << "." << std::endl;
+    return false;
+  }
+  char header[64];
+  int header_size = snprintf(header, sizeof(header), "P%c\n%u %u\n%u\n", channels == 3 ? '6' : '5', width, height, max_value);
+  size_t size = (size_t)width * height * channels * (max_value > 255 ? 2 : 1);
+
+  int fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    std::cerr << "Could not open " << file_name << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+  struct iovec parts[2];
+  parts[0].iov_base = header;
+  parts[0].iov_len = header_size;
+  parts[1].iov_base = (void*)data;
+  parts[1].iov_len = size;
+  struct iovec* part = parts;
+  int count = 2;
+  // Regular files are written at once, the loop only handles interrupted or partial writes
+  while (count > 0)
+  {
+    ssize_t written = writev(fd, part, count);
+    if (written < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      std::cerr << "Could not write " << file_name << ": " << strerror(errno) << std::endl;
+      close(fd);
+      return false;
+    }
+    while (count > 0 && (size_t)written >= part->iov_len)
+    {
+      written -= part->iov_len;
+      ++part;
+      --count;
+    }
+    if (count > 0)
+    {
+      part->iov_base = (char*)part->iov_base + written;
+      part->iov_len -= written;
+    }
+  }
+  return close(fd) == 0;
+}
+
 /**
     Reads a PPM file into a buffer
     @param file_name the ppm file to read from. Extension must be .ppm
@@ -16,18 +215,20 @@
 */
 inline unsigned char* load_ppm(char* file_name, uint &width, uint &height)
 {
-  std::ifstream file(file_name);
-  std::string magic_number;
-  uint max_value;
-  file >> magic_number >> width >> height >> max_value;
-  if (magic_number != "P6")
-    throw std::invalid_argument("Current PPM Image format is " + magic_number  + " and must be P6");
-  if (max_value > 255)
-    throw std::invalid_argument("Max value is " + std::to_string(max_value) + "but it should not be > 255");
-
-  size_t size = width * height * 3;
-  unsigned char* data = new unsigned char[size];
-  file.read((char*)(&data[0]), size);
+  PnmImage image;
+  if (!map_pnm(file_name, image))
+    throw std::invalid_argument(std::string("Could not read PPM image ") + file_name);
+  if (image.channels != 3 || image.max_value > 255)
+  {
+    unmap_pnm(image);
+    throw std::invalid_argument("Current PPM Image format must be P6 with a max value <= 255");
+  }
+
+  width = image.width;
+  height = image.height;
+  unsigned char* data = new unsigned char[image.size];
+  memcpy(data, image.data, image.size);
+  unmap_pnm(image);
   return data;
 }
 
@@ -40,17 +241,12 @@ inline unsigned char* load_ppm(char* file_name, uint &width, uint &height)
 */
 inline void write_ppm(char* file_name, unsigned char* data, int width, int height)
 {
-  std::ofstream file(file_name);
-  file << "P6" << "\n"
-	   << width << "\n"
-	   << height << "\n"
-	   << 255 << "\n";
-  size_t size = width * height * 3;
-  file.write((char*)(&data[0]), size);
+  write_pnm(file_name, data, width, height, 3);
 }
 
 /**
     Utils function to convert a uchar buffer into an float buffer
+    (convert_uchar_to_float() does it without allocating)
     @param data the buffer that contains image data
     @param size the total size of the buffer
     @return the buffer that contains the data converted from unsigned char to float.
@@ -58,15 +254,13 @@ inline void write_ppm(char* file_name, unsigned char* data, int width, int heigh
 inline float* uchar_to_float(unsigned char* data, uint size)
 {
   float* float_data = new float[size];
-  for (uint i = 0 ; i < size ; ++i)
-  {
-	float_data[i] = static_cast<float>(data[i]);
-  }
+  convert_uchar_to_float(data, float_data, size);
   return float_data;
 }
 
 /**
-    Utils function to convert a float buffer into an uchar buffer
+    Utils function to convert a float buffer into an uchar buffer, values are rounded & clamped to [0, 255]
+    (convert_float_to_uchar() does it without allocating)
     @param data the buffer that contains image data
     @param size the total size of the buffer
     @return the buffer that contains the data converted from float to unsigned char.
@@ -74,18 +268,13 @@ inline float* uchar_to_float(unsigned char* data, uint size)
 inline unsigned char* float_to_uchar(float* data, uint size)
 {
   unsigned char* uchar_data = new unsigned char[size];
-  for (uint i = 0 ; i < size ; i++)
-  {
-	float value = data[i];
-	if (value < 0) value = 0;
-	if (value > 255) value = 255;
-	uchar_data[i] = static_cast<float>(data[i]);
-  }
+  convert_float_to_uchar(data, uchar_data, size);
   return uchar_data;
 }
 
 /**
     Utils function to convert a RGB image to GRAYSCALE image
+    (convert_rgb_to_gray() does it without allocating)
     @param data the buffer that contains image data
     @param width the width of the image
     @param height the height of the image
@@ -94,17 +283,13 @@ inline unsigned char* float_to_uchar(float* data, uint size)
 inline unsigned char* rgb_to_gray(unsigned char* data, uint width, uint height)
 {
   unsigned char* data_gray = new unsigned char[width * height];
-  int cpt = 0;
-  for (uint i = 0 ; i < width * height * 3; i+=3)
-  {
-	data_gray[cpt++] = (data[i] + data[i+1] + data[i+2]) / 3;
-  }
-  
+  convert_rgb_to_gray(data, data_gray, (size_t)width * height);
   return data_gray;
 }
 
 /**
     Utils function to convert a GRAYSCALE image to 3CHAN (RGB) image
+    (convert_gray_to_rgb() does it without allocating)
     @param data the buffer that contains image data
     @param width the width of the image
     @param height the height of the image
@@ -113,24 +298,47 @@ inline unsigned char* rgb_to_gray(unsigned char* data, uint width, uint height)
 inline unsigned char* gray_to_rgb(unsigned char* data, uint width, uint height)
 {
   unsigned char* data_rgb = new unsigned char[width * height * 3];
-  int cpt = 0;
-  for (uint i = 0 ; i < width * height; ++i)
-  {
-	data_rgb[cpt++] = data[i];
-	data_rgb[cpt++] = data[i];
-	data_rgb[cpt++] = data[i];
-  }
-  
+  convert_gray_to_rgb(data, data_rgb, (size_t)width * height);
   return data_rgb;
 }
 
+/**
+    Utils function to fill an image with random values in [0, 255], in place
+    Each task runs its own generator seeded from rand(), so srand() still makes the result reproducible.
+    @param dst the image, width * height * channel values (8 bits or float)
+    @param width the width of the image
+    @param height the height of the image
+    @param channel the number of channels
+*/
+template <typename T>
+inline void fill_random_image(T* dst, uint width, uint height, uint channel)
+{
+  const unsigned int seed = rand();
+  TileScheduler::global().parallel_for_range((size_t)width * height * channel, IMAGE_UTILS_GRAIN, [&](size_t begin, size_t end) {
+    // xorshift32, seeded per chunk (the state must never be 0)
+    unsigned int state = (seed ^ (unsigned int)(begin / IMAGE_UTILS_GRAIN * 2654435761u)) | 1u;
+    for (size_t i = begin ; i < end ; ++i)
+    {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      dst[i] = (T)(state % 256);
+    }
+  });
+}
+
+/**
+    Utils function to generate an image filled with random values in [0, 255]
+    (fill_random_image() does it without allocating, the values are the same for the same seed)
+    @param width the width of the image
+    @param height the height of the image
+    @param channel the number of channels
+    @return the generated image
+*/
 inline float* generate_random_image(uint width, uint height, uint channel)
 {
   float* img = new float[width * height * channel];
-  for (int i = 0 ; i < width * height * channel ; ++i)
-  {
-    img[i] = rand()%256;
-  }
+  fill_random_image(img, width, height, channel);
   return img;
 }
 
@@ -0,0 +1,89 @@
+#ifndef _PROGRAM_CACHE_HPP_
+#define _PROGRAM_CACHE_HPP_
+
+#include <GLES2/gl2.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+    Shader program cache of a GL context.
+    Programs are identified by a hash of their vertex & fragment sources and of the driver
+    (GL_RENDERER & GL_VERSION), so editing a shader or updating the driver invalidates them.
+
+    - Compiled shader objects are kept per source, a vertex shader shared by every pass
+      (shader/simple.vert) is only compiled once.
+    - When the driver can export programs (GL_OES_get_program_binary on OpenGL ES 2,
+      OpenGL ES 3, GL_ARB_get_program_binary) the linked binary is kept in memory and written
+      to the cache directory, later processes then skip compilation altogether. Files are written
+      through a temporary file per process & thread, so several processes or worker contexts can
+      write the same binary at once.
+      A binary the driver rejects is silently replaced by a source compilation.
+
+    Every call to load() returns a new program object: passes set their own uniforms once
+    at creation (see GaussianBlur), so they cannot share one.
+    The cache directory is $IPOGLES_SHADER_CACHE, or $XDG_CACHE_HOME/ipogles, or $HOME/.cache/ipogles.
+    Setting IPOGLES_SHADER_CACHE to an empty string disables the on-disk cache.
+**/
+class ProgramCache
+{
+public:
+    ProgramCache();
+    ~ProgramCache();
+
+    /**
+        Create a program from a shader pair on disk.
+        @param vertex_shader_path the path to the vertex shader
+        @param fragment_shader_path the path to the fragment shader
+        @return the linked program or 0 on failure (see stderr for details).
+    */
+    GLuint load(const std::string& vertex_shader_path, const std::string& fragment_shader_path);
+
+    /**
+        Create a program from shader sources.
+        @param vertex_source the GLSL source of the vertex shader
+        @param fragment_source the GLSL source of the fragment shader
+        @return the linked program or 0 on failure (see stderr for details).
+    */
+    GLuint load_source(const std::string& vertex_source, const std::string& fragment_source);
+
+    /**
+        Delete the cached shader objects & forget the binaries kept in memory.
+        Must be called while the owning context is current.
+    */
+    void clear();
+
+    /**
+        @return true if programs are saved & restored as driver binaries.
+    */
+    bool binaries_supported();
+
+    const std::string& directory() const { return m_directory; }
+
+private:
+    struct Binary
+    {
+        GLenum format;
+        std::vector<char> data;
+    };
+
+    void init_binary_support();
+    GLuint shader(GLenum type, const std::string& source);
+    GLuint from_binary(const Binary& binary);
+    bool read_binary(const std::string& path, Binary &binary);
+    void write_binary(const std::string& path, const Binary& binary);
+
+    std::map<std::string, GLuint> m_shaders;  // Compiled shader objects by source hash
+    std::map<std::string, Binary> m_binaries; // Linked programs by program hash
+    std::string m_directory;
+    std::string m_driver;
+    bool m_initialized;
+
+    // Resolved at first use, NULL when the driver cannot export programs
+    void (*m_get_program_binary)(GLuint, GLsizei, GLsizei*, GLenum*, void*);
+    void (*m_program_binary)(GLuint, GLenum, const void*, GLint);
+    void (*m_program_parameter)(GLuint, GLenum, GLint);
+};
+
+#endif
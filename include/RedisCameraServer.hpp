@@ -4,17 +4,125 @@
 #include <opencv2/opencv.hpp>
 #include <RedisImageHelper.hpp>
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ShmFrameRing.hpp"
+#include "RedisTransport.hpp"
+
 class RedisCameraServer
 {
 private:
     RedisImageHelper* m_imageClient;
     cv::VideoCapture* m_camera;
+    std::string m_cameraKey;
+
+    // Pipelined connection for shared memory metadata & frame events
+    RedisTransport* m_metadata;
+    bool connectMetadata();
+
+    // Shared memory transport, enabled by enableSharedMemory()
+    ShmFrameRing* m_ring;
+    std::string m_shmName;
+    int m_shmSlots;
+    bool m_yuv; // The camera delivers I420 frames, handed over as they are (see enableYuvFrames())
+
+    // Frame events, enabled by enableFrameEvents()
+    bool m_events;
+    unsigned long long m_eventSequence;
+    bool publishFrameEvent(const std::string& key, int width, int height, int channels, unsigned long long ringSequence);
+
+    // Background capture, enabled by startCapture()
+    struct CapturedFrame
+    {
+        cv::Mat image;                  // RGB, or I420 planes. Allocated by the first frame, then reused
+        Image* redisImage;              // Owner of the RGB buffer that image wraps, handed to Redis as is. NULL for I420
+        unsigned long long sequence;    // Capture number, starting at 1
+        long long timestamp;            // Capture time in microseconds since the epoch
+    };
+    std::vector<CapturedFrame> m_captured;
+    std::thread m_captureThread;
+    std::atomic<bool> m_capturing;
+    std::mutex m_captureMutex;
+    int m_latest, m_reading;            // Slots of the freshest frame & of the one being published, -1 for none
+    unsigned long long m_sequence, m_published;
+    long long m_publishedTime;
+    std::atomic<unsigned long long> m_dropped;
+
+    // Redis image of the frames published without background capture, reused while the size does not change
+    Image* m_frameImage;
+    cv::Mat m_frameBuffer;
+
+    static void reuseImage(Image*& image, cv::Mat& buffer, int width, int height);
+    void releaseCaptured();
+    void captureLoop();
+    bool publishFrame(const cv::Mat& frame, bool bgr, unsigned long long sequence, long long timestamp, Image* image = NULL);
+    bool publishSharedFrame(const cv::Mat& frame, bool bgr, unsigned long long sequence, long long timestamp,
+                            unsigned long long &ringSequence);
+
 public:
     RedisCameraServer();
+    ~RedisCameraServer();
     bool start(std::string command);
     bool start();
-    void pickUpCameraFrame();
-    void setCameraKey(std::string cameraKey) { m_imageClient->setCameraKey(cameraKey); };
+
+    /**
+        Publish a camera frame. Without background capture it reads the camera, waiting for the next frame.
+        With background capture it publishes the freshest captured frame right away.
+        @return true if a new frame was published, false if none was captured since the last call (or on errors)
+    */
+    bool pickUpCameraFrame();
+
+    /**
+        Capture continuously on a dedicated thread. Frames are converted to RGB into a ring of
+        pre-allocated images and stamped with their sequence & capture time; when frames are not
+        picked up fast enough the oldest ones are overwritten (see droppedFrames()).
+        @param slots the number of frames in the ring, at least 3 (freshest, being published, being captured)
+        @return true if the thread was started
+    */
+    bool startCapture(int slots = 3);
+    void stopCapture();
+
+    /**
+        @return the camera sequence & capture time (microseconds since the epoch) of the last published frame
+    */
+    unsigned long long lastSequence() const { return m_published; }
+    long long lastCaptureTime() const { return m_publishedTime; }
+    unsigned long long droppedFrames() const { return m_dropped; }
+
+    void setCameraKey(std::string cameraKey) { m_cameraKey = cameraKey; m_imageClient->setCameraKey(cameraKey); };
+
+    /**
+        Hand frames to same-host processors through a shared memory ring instead of Redis.
+        Each frame is converted to RGB straight into the ring and only
+        "<name> <sequence> <width> <height> <channels> <camera sequence> <capture time (us)> [I420]"
+        is written to <camera key>:shm, so consumers still discover frames through Redis.
+        @param name the shared memory object name, e.g. "/ipogles_camera"
+        @param slots the number of frames kept in the ring
+        @return true if the metadata connection could be opened
+    */
+    bool enableSharedMemory(std::string name, int slots = 4);
+
+    /**
+        Announce every published frame on the <camera key>:frames channel, so that processors
+        wait for frames instead of polling the camera key. The message is
+            "<sequence> <key> <width> <height> <channels>" for frames stored in Redis at <key>,
+            "<sequence> <name> <width> <height> <channels> <ring sequence> [I420]" for shared memory frames.
+        The sequence goes up by one per published frame: a gap means a subscriber missed frames.
+        @return true if the event connection could be opened
+    */
+    bool enableFrameEvents();
+
+    /**
+        Hand I420 camera frames over without converting them: the planes go to the shared memory
+        ring as a single channel image of height * 3 / 2 rows, and the metadata & events end with
+        " I420" (width & height being the picture size), so that processors convert them on the GPU
+        (see GpuFilterContext::upload_yuv()). The capture pipeline must deliver I420 to OpenCV.
+        @return true if shared memory is enabled, YUV frames are not published through Redis
+    */
+    bool enableYuvFrames();
 };
 
 #endif // REDISCAMERASERVER_H
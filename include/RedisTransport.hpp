@@ -0,0 +1,113 @@
+#ifndef _REDIS_TRANSPORT_HPP_
+#define _REDIS_TRANSPORT_HPP_
+
+#include <hiredis/hiredis.h>
+
+#include <cstddef>
+#include <deque>
+#include <string>
+
+/**
+    Pipelined binary transport for frames over one Redis connection.
+    Commands are appended to the connection output buffer without waiting for their reply, so any
+    number of GET/SET can be in flight; replies are then collected in order with read_reply().
+    Payloads are passed to hiredis straight from the caller buffer (no intermediate copy) and GET
+    payloads are either copied once into a caller buffer or used in place from the reply.
+
+    Typical streaming use:
+        transport.append_set(key, frame, size);     // returns immediately
+        transport.flush();                          // writes, does not wait for the reply
+        ...
+        while (transport.pending() > 4) transport.read_reply();
+**/
+class RedisTransport
+{
+public:
+    RedisTransport();
+    ~RedisTransport();
+
+    /**
+        @return true on success, false otherwise (see stderr for details).
+    */
+    bool connect(const std::string& hostname = "127.0.0.1", int port = 6379);
+    void close();
+
+    /**
+        Queue a GET, its reply is collected by read_reply().
+    */
+    bool append_get(const std::string& key);
+
+    /**
+        Queue a SET. The data is serialised right away, the buffer can be reused as soon as this returns.
+    */
+    bool append_set(const std::string& key, const void* data, size_t size);
+
+    /**
+        Queue a PUBLISH, e.g. a small event announcing a new frame.
+    */
+    bool append_publish(const std::string& channel, const void* data, size_t size);
+
+    /**
+        Switch the connection to subscriber mode on a channel. A subscribed connection only
+        receives messages (read_message()), other commands need another connection.
+        @return false on connection errors.
+    */
+    bool subscribe(const std::string& channel);
+
+    /**
+        Wait for the next message of the subscribed channel.
+        @param payload a reference receiving the message
+        @param timeout_ms the maximum wait in milliseconds, -1 to block until a message comes
+        @return false on timeout or errors (the connection is closed after errors, see connected())
+    */
+    bool read_message(std::string& payload, int timeout_ms = -1);
+
+    /**
+        Send the queued commands now without waiting for their replies, so that the server
+        processes them while the caller goes on (otherwise they leave with the next read).
+        @return false on connection errors.
+    */
+    bool flush();
+
+    /**
+        Wait for the oldest pending reply (sends the queued commands first if needed).
+        @param dst where to copy a GET payload, NULL to ignore it
+        @param capacity the size of dst
+        @param size a pointer receiving the payload size, may be NULL
+        @return false on connection errors, error replies, missing keys or payloads larger than capacity.
+    */
+    bool read_reply(void* dst = NULL, size_t capacity = 0, size_t* size = NULL);
+
+    /**
+        Wait for the oldest pending reply & give access to its payload without copying it.
+        @param size a reference receiving the payload size
+        @return the payload, valid until the next read, or NULL (see read_reply()).
+    */
+    const unsigned char* read_reply_in_place(size_t &size);
+
+    /**
+        Wait for every pending reply.
+        @return false if any of them failed.
+    */
+    bool drain();
+
+    /**
+        Round trip helpers, for code that needs the result right away.
+    */
+    bool get(const std::string& key, void* dst, size_t capacity, size_t* size = NULL);
+    bool set(const std::string& key, const void* data, size_t size);
+
+    size_t pending() const { return m_pending; }
+    bool connected() const { return m_context != NULL; }
+
+private:
+    bool append(int argc, const char** argv, const size_t* argvlen);
+    redisReply* next_reply();
+    redisReply* buffered_reply();
+
+    redisContext* m_context;
+    redisReply* m_reply; // Last reply read in place, freed by the next read
+    size_t m_pending;
+};
+
+#endif
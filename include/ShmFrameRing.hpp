@@ -0,0 +1,101 @@
+#ifndef _SHM_FRAME_RING_HPP_
+#define _SHM_FRAME_RING_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+/**
+    Ring of frames in POSIX shared memory, to hand frames between processes of the same host
+    without copying them through a socket.
+
+    One producer writes frames in turn into the slots of the ring, each frame gets the next
+    sequence number (starting at 1). Consumers read any frame still in the ring by its sequence.
+    Nothing ever blocks: the producer overwrites the oldest slot, and every slot is protected by a
+    sequence lock so that a consumer can tell whether the frame it read was overwritten meanwhile.
+        slot sequence = 2 * s + 1 while frame s is being written, 2 * s once it is published.
+    Consumers can use a frame in place (e.g. upload it to a texture straight from shared memory)
+    and call valid() afterwards to know whether what they used was intact.
+**/
+class ShmFrameRing
+{
+public:
+    ShmFrameRing();
+    ~ShmFrameRing();
+
+    /**
+        Create (or replace) a ring, as the producer. The segment is unlinked by close().
+        @param name the shared memory object name, e.g. "/ipogles_camera"
+        @param slots the number of frames kept in the ring
+        @param slot_size the maximum size in bytes of a frame
+        @return true on success, false otherwise (see stderr for details).
+    */
+    bool create(const std::string& name, int slots, size_t slot_size);
+
+    /**
+        Map an existing ring read only, as a consumer.
+        @param name the shared memory object name given to create()
+        @return true on success, false otherwise (see stderr for details).
+    */
+    bool open(const std::string& name);
+
+    /**
+        Unmap the ring, and unlink it when it was created by this object.
+    */
+    void close();
+
+    /**
+        Start writing the next frame. Consumers see the slot as busy until end_write().
+        @return the slot memory to fill, or NULL if the frame is larger than slot_size()
+    */
+    unsigned char* begin_write(int width, int height, int channels);
+
+    /**
+        Publish the frame started by begin_write().
+        @return its sequence number
+    */
+    unsigned long long end_write();
+
+    /**
+        Access a frame in place.
+        @param sequence the sequence number of the frame
+        @return the frame data, or NULL if it is not published yet or was already overwritten
+    */
+    const unsigned char* frame(unsigned long long sequence, int &width, int &height, int &channels) const;
+
+    /**
+        @return true if the frame is still intact, i.e. everything read from it since frame() is consistent
+    */
+    bool valid(unsigned long long sequence) const;
+
+    /**
+        Copy a frame out of the ring.
+        @param dst the destination, must hold capacity bytes
+        @return false if the frame is not available, does not fit or was overwritten while copying
+    */
+    bool read(unsigned long long sequence, unsigned char* dst, size_t capacity, int &width, int &height, int &channels) const;
+
+    /**
+        @return the sequence number of the last published frame, 0 if none
+    */
+    unsigned long long latest() const;
+
+    int slots() const;
+    size_t slot_size() const;
+    const std::string& name() const { return m_name; }
+    bool is_open() const { return m_header != NULL; }
+
+private:
+    struct Header;
+    struct Slot;
+
+    Slot* slot(unsigned long long sequence) const;
+    bool map(int fd, size_t size, bool writable);
+
+    std::string m_name;
+    Header* m_header;
+    size_t m_mapped_size;
+    bool m_owner;
+};
+
+#endif
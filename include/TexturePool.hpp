@@ -0,0 +1,70 @@
+#ifndef _TEXTURE_POOL_HPP_
+#define _TEXTURE_POOL_HPP_
+
+#include <GLES2/gl2.h>
+
+#include <cstddef>
+#include <list>
+
+/**
+    A texture along with the FBO it is attached to (0 for plain input textures).
+**/
+struct RenderTarget
+{
+    GLuint fbo, texture;
+    int width, height;
+    GLenum format, type;
+};
+
+/**
+    Recycles textures & FBOs of the current GL context instead of generating new ones every frame.
+    Resources are keyed by (width, height, format, type): format is the internal format (unsized, or GL_RGBA32F_EXT) and
+    type the pixel type the storage was allocated with, which OpenGL ES 2 requires every later
+    glTexSubImage2D to match.
+    Released resources are kept in an LRU list; once their total size exceeds the budget the least
+    recently released ones are deleted, so sweeping many sizes does not grow VRAM without bound.
+**/
+class TexturePool
+{
+public:
+    /**
+        @param budget the maximum number of bytes kept in free resources
+    */
+    explicit TexturePool(size_t budget = 256 * 1024 * 1024);
+    ~TexturePool();
+
+    /**
+        Get an input texture, its storage is allocated but its content undefined.
+        Fill it with glTexSubImage2D.
+        @return the texture (fbo is 0) or a texture of 0 on failure
+    */
+    RenderTarget acquire_texture(int width, int height, GLenum format = GL_RGB, GLenum type = GL_UNSIGNED_BYTE);
+
+    /**
+        Get a texture attached to an FBO, ready to be rendered into.
+        @return the render target or a target with an fbo of 0 on failure
+    */
+    RenderTarget acquire_target(int width, int height, GLenum format = GL_RGB, GLenum type = GL_UNSIGNED_BYTE);
+
+    /**
+        Give a texture or render target back to the pool. Releasing a null resource is a no-op.
+    */
+    void release(const RenderTarget& target);
+
+    /**
+        Delete every free resource. Must be called while the owning context is current.
+    */
+    void clear();
+
+    size_t free_bytes() const { return m_free_bytes; }
+
+private:
+    RenderTarget acquire(int width, int height, GLenum format, GLenum type, bool with_fbo);
+    static size_t byte_size(const RenderTarget& target);
+    static void destroy(const RenderTarget& target);
+
+    std::list<RenderTarget> m_free; // Most recently released first
+    size_t m_free_bytes, m_budget;
+};
+
+#endif
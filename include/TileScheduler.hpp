@@ -0,0 +1,120 @@
+#ifndef _TILE_SCHEDULER_HPP_
+#define _TILE_SCHEDULER_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+    A rectangular piece of an image. (x, y, width, height) is the region the tile is responsible for,
+    the halo_* rectangle extends it by the kernel radius on every side (clamped to the image) and is
+    what an operator has to read to compute the tile.
+**/
+struct Tile
+{
+    int x, y, width, height;
+    int halo_x, halo_y, halo_width, halo_height;
+};
+
+/**
+    Split an image into tiles of at most tile_width x tile_height pixels, row by row.
+    @param width the width of the image
+    @param height the height of the image
+    @param tile_width the maximum width of a tile
+    @param tile_height the maximum height of a tile
+    @param halo the number of pixels of context needed around each tile
+    @return the tiles, covering the image without overlap (halos aside)
+*/
+std::vector<Tile> make_tiles(int width, int height, int tile_width, int tile_height, int halo);
+
+/**
+    Parallel executor for CPU side image operators.
+    Work is split into tiles that are dealt out in contiguous blocks to per-thread deques; a thread
+    pops from the back of its own deque and, once empty, steals from the front of the others.
+    The calling thread takes part in the work, so nested calls from inside a task cannot deadlock.
+**/
+class TileScheduler
+{
+public:
+    /**
+        @param threads the number of threads taking part in the work (calling thread included), 0 for one per core
+    */
+    explicit TileScheduler(unsigned threads = 0);
+    ~TileScheduler();
+
+    /**
+        The process wide scheduler. Its size can be forced with the IPOGLES_THREADS environment variable.
+    */
+    static TileScheduler& global();
+
+    /**
+        Call func(i) for every i in [0, count) and wait for all of them to complete.
+    */
+    void parallel_for(size_t count, const std::function<void(size_t)>& func);
+
+    /**
+        Call func(begin, end) on consecutive chunks of [0, size) of at most grain elements.
+        Used by the linear pixel conversions.
+    */
+    void parallel_for_range(size_t size, size_t grain, const std::function<void(size_t, size_t)>& func);
+
+    /**
+        Split an image into tiles & call func on each of them in parallel.
+        @param width the width of the image
+        @param height the height of the image
+        @param tile_width the maximum width of a tile
+        @param tile_height the maximum height of a tile
+        @param halo the number of pixels of context needed around each tile
+        @param func the operator applied to every tile
+    */
+    void for_each_tile(int width, int height, int tile_width, int tile_height, int halo,
+                       const std::function<void(const Tile&)>& func);
+
+    /**
+        The number of full rows that fit in a cache-sized tile (L2 sized, ~256 KB).
+        @param bytes_per_row the number of bytes read per image row
+        @return the tile height, at least 1
+    */
+    static int tile_rows(size_t bytes_per_row);
+
+    unsigned thread_count() const { return (unsigned)m_queues.size(); }
+
+private:
+    struct Batch
+    {
+        const std::function<void(size_t)>* func;
+        std::atomic<size_t> remaining;
+    };
+
+    struct Task
+    {
+        Batch* batch;
+        size_t index;
+    };
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void worker_loop(unsigned id);
+    bool pop_or_steal(unsigned id, Task &task);
+    void run(const Task& task);
+
+    // One queue per participant, the last one is shared by the threads calling into the pool.
+    std::vector<Queue*> m_queues;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake, m_done;
+    size_t m_pending; // Queued tasks, guarded by m_mutex
+    bool m_stop;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef _CPU_FILTERS_HPP_
+#define _CPU_FILTERS_HPP_
+
+#include <string>
+
+/**
+    Native CPU implementations of the filters in shader/, for hosts without a usable GPU.
+    They work on tightly packed 8 bits RGB buffers (as produced by load_ppm), borders are
+    clamped to edge like the GL textures, and the inner loops are vectorised with AVX2, SSE2
+    or NEON depending on the target (see cpu_simd_name()).
+
+    They reproduce the GLSL operators, weights included, and double as a correctness oracle:
+    compared to the GL output (8 bits render target) every channel is within +/-1, the only
+    differences being the rounding of float sums that land on .5 (summation order differs).
+*/
+
+enum CpuFilter
+{
+    CPU_GAUSSIAN3, // shader/gaussian3.frag
+    CPU_GAUSSIAN5, // shader/gaussian5.frag
+    CPU_SOBEL      // shader/sobel.frag
+};
+
+/**
+    Find the CPU implementation of a fragment shader, based on its file name.
+    @param fragment_shader_path the path to the fragment shader (e.g. shader/sobel.frag)
+    @param filter a reference to the matching filter
+    @return true if the shader has a CPU implementation, false otherwise.
+*/
+bool cpu_filter_from_shader(const std::string& fragment_shader_path, CpuFilter &filter);
+
+/**
+    Apply a filter to the rows [y_begin, y_end) of an image. Rows outside of that range are
+    read (for the kernel support) but never written, so disjoint ranges can run concurrently.
+    @param filter the filter to apply
+    @param src the source image (RGB, 8 bits)
+    @param dst the destination image (RGB, 8 bits), must not alias src
+    @param width the width of the image
+    @param height the height of the image
+    @param y_begin the first row to compute
+    @param y_end one past the last row to compute
+*/
+void cpu_filter_rows(CpuFilter filter, const unsigned char* src, unsigned char* dst,
+                     int width, int height, int y_begin, int y_end);
+
+/**
+    @return the radius of the filter kernel, i.e. the halo a tile needs around it.
+*/
+int cpu_filter_radius(CpuFilter filter);
+
+/**
+    @return the (2 * radius + 1)^2 weights of a convolution filter, row by row from the top, NULL for CPU_SOBEL.
+*/
+const float* cpu_filter_kernel(CpuFilter filter);
+
+/**
+    Apply a filter to a whole image, split in tiles run in parallel on TileScheduler::global().
+    @param filter the filter to apply
+    @param src the source image (RGB, 8 bits)
+    @param dst the destination image (RGB, 8 bits), must not alias src
+    @param width the width of the image
+    @param height the height of the image
+*/
+void cpu_filter(CpuFilter filter, const unsigned char* src, unsigned char* dst, int width, int height);
+
+/**
+    @return the instruction set the CPU filters were compiled for ("AVX2", "SSE2", "NEON" or "scalar").
+*/
+const char* cpu_simd_name();
+
+#endif
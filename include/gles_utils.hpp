@@ -9,6 +9,27 @@
 #include <string>
 #include <fstream>
 #include <streambuf>
+#include <cstring>
+#include <cstdio>
+
+#ifndef GL_HALF_FLOAT_OES
+#define GL_HALF_FLOAT_OES 0x8D61
+#endif
+#ifndef GL_HALF_FLOAT
+#define GL_HALF_FLOAT 0x140B
+#endif
+#ifndef GL_BGR_EXT
+#define GL_BGR_EXT 0x80E0
+#endif
+#ifndef GL_BGRA_EXT
+#define GL_BGRA_EXT 0x80E1
+#endif
+#ifndef GL_RED_EXT
+#define GL_RED_EXT 0x1903
+#endif
+#ifndef GL_RGBA32F_EXT
+#define GL_RGBA32F_EXT 0x8814
+#endif
 
 /**
      EGL Configuration variables.
@@ -60,6 +81,58 @@ inline bool check(GLuint object, GLenum to_check,
   return true;
 }
 
+/**
+     Read a whole text file, typically a shader source
+     @param path the path to the file
+     @param content a reference to the string receiving the file content
+     @return true if the file could be read, false otherwise
+*/
+inline bool read_file(const std::string& path, std::string &content)
+{
+    std::ifstream file(path.c_str());
+    if (!file.is_open())
+        return false;
+    content.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return true;
+}
+
+/**
+     Compile a shader from its source
+     @param type GL_VERTEX_SHADER or GL_FRAGMENT_SHADER
+     @param source the GLSL source code
+     @return the shader object or 0 if it does not compile (the log is printed on stderr)
+*/
+inline GLuint compile_shader(GLenum type, const std::string& source)
+{
+    GLuint shader = glCreateShader(type);
+    const char* code = source.c_str();
+    glShaderSource(shader, 1, &code, NULL);
+    glCompileShader(shader);
+    if (!check(shader, GL_COMPILE_STATUS, glGetShaderiv, glGetShaderInfoLog, glDeleteShader))
+        return 0;
+    return shader;
+}
+
+/**
+     Link a vertex & a fragment shader into a program. The shaders are left untouched.
+     @param vertex_shader the compiled vertex shader
+     @param fragment_shader the compiled fragment shader
+     @return the program or 0 if it does not link (the log is printed on stderr)
+*/
+inline GLuint link_program(GLuint vertex_shader, GLuint fragment_shader)
+{
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertex_shader);
+    glAttachShader(program, fragment_shader);
+    glLinkProgram(program);
+    if (!check(program, GL_LINK_STATUS, glGetProgramiv, glGetProgramInfoLog, glDeleteProgram))
+        return 0;
+    // Linked programs keep their own copy of the compiled code
+    glDetachShader(program, vertex_shader);
+    glDetachShader(program, fragment_shader);
+    return program;
+}
+
 /**
      Load shader programs from file name
      Do several checks to ensure that shaders are valid & compile
@@ -71,46 +144,36 @@ inline bool check(GLuint object, GLenum to_check,
 inline GLuint load_shaders(std::string vertex_shader_path,
                            std::string fragment_shader_path)
 {
-    // Create Vertex shader
-    GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-    // Loading source
-    std::ifstream vertex_shader_file(vertex_shader_path);
-    if (!vertex_shader_file.is_open())
+    // Loading vertex source
+    std::string vertex_shader_code;
+    if (!read_file(vertex_shader_path, vertex_shader_code))
     {
         std::cerr << "Could not open vertex shader file: '" << vertex_shader_path << " '. Invalid file." << std::endl;
         return 0;
     }
-    std::string vertex_shader_code((std::istreambuf_iterator<char>(vertex_shader_file)),
-                     std::istreambuf_iterator<char>());
-    const char* vertex_code = vertex_shader_code.c_str();
+    // Loading fragment source
+    std::string fragment_shader_code;
+    if (!read_file(fragment_shader_path, fragment_shader_code))
+    {
+        std::cerr << "Could not open fragment shader file: '" << fragment_shader_path << " '. Invalid file." << std::endl;
+        return 0;
+    }
 
-    glShaderSource(vertex_shader, 1, &vertex_code, NULL);
-    glCompileShader(vertex_shader);
-    if (!check(vertex_shader, GL_COMPILE_STATUS, glGetShaderiv, glGetShaderInfoLog, glDeleteShader)) {
+    // Create Vertex shader
+    GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER, vertex_shader_code);
+    if (!vertex_shader) {
           std::cerr << "Failed to compile vertex shader." << std::endl;
-          return -1;
+          return 0;
     }
     else {
           std::cerr << "Successfully compilated vertex shader." << std::endl;
     }
 
     // Create Fragment shader
-    GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-    // Loading source
-    std::ifstream fragment_shader_file(fragment_shader_path);
-    if (!fragment_shader_file.is_open())
-    {
-        std::cerr << "Could not open fragment shader file: '" << fragment_shader_path << " '. Invalid file." << std::endl;
-        return 0;
-    }
-    std::string fragment_shader_code((std::istreambuf_iterator<char>(fragment_shader_file)),
-                     std::istreambuf_iterator<char>());
-    const char* fragment_code = fragment_shader_code.c_str();
-
-    glShaderSource(fragment_shader, 1, &fragment_code, NULL);
-    glCompileShader(fragment_shader);
-    if (!check(fragment_shader, GL_COMPILE_STATUS, glGetShaderiv, glGetShaderInfoLog, glDeleteShader)) {
+    GLuint fragment_shader = compile_shader(GL_FRAGMENT_SHADER, fragment_shader_code);
+    if (!fragment_shader) {
           std::cerr << "Failed to compile fragment shader." << std::endl;
+          glDeleteShader(vertex_shader);
           return 0;
     }
     else {
@@ -118,12 +181,10 @@ inline GLuint load_shaders(std::string vertex_shader_path,
     }
 
     // Create a shader program
-    GLuint program = glCreateProgram();
-    glUseProgram(program);
-    glAttachShader(program, vertex_shader);
-    glAttachShader(program, fragment_shader);
-    glLinkProgram(program);
-    if (!check(program, GL_LINK_STATUS, glGetProgramiv, glGetProgramInfoLog, glDeleteProgram)) {
+    GLuint program = link_program(vertex_shader, fragment_shader);
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+    if (!program) {
           std::cerr << "Failed to link program." << std::endl;
           return 0;
     }
@@ -134,15 +195,28 @@ inline GLuint load_shaders(std::string vertex_shader_path,
     return program;
 }
 
+/**
+     Transfer format of an internal format: sized formats map to their unsized one.
+     @param internal_format the internal format of a texture
+     @return the format to pass along with it to glTexImage2D
+*/
+inline GLenum pixel_format(GLenum internal_format)
+{
+    return internal_format == GL_RGBA32F_EXT ? GL_RGBA : internal_format;
+}
+
 /**
      Initialize a Frame Buffer Object with given width & height
      /!\ It appears that it's size should be power of 2.
      @param width the width of the FBO
      @param height the height of the FBO
-     @param fbo_render_texture the FBO render texture id (generated by this func)
+     @param fbo_render_texture a reference to the FBO render texture id (generated by this func)
+     @param format the internal format of the render texture, unsized (GL_RGB by default) or GL_RGBA32F_EXT (see float_targets_supported())
+     @param type the pixel type of the render texture (GL_UNSIGNED_BYTE by default)
      @return the fbo id.
 */
-inline int init_fbo(int width, int height, GLuint fbo_render_texture)
+inline GLuint init_fbo(int width, int height, GLuint &fbo_render_texture,
+                       GLenum format = GL_RGB, GLenum type = GL_UNSIGNED_BYTE)
 {
     //1. Generate Frame Buffer Object
     GLuint fboId;
@@ -155,15 +229,21 @@ inline int init_fbo(int width, int height, GLuint fbo_render_texture)
     //4. Bind it
     glBindTexture(GL_TEXTURE_2D, fbo_render_texture);
     //5. Set texture properties
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, pixel_format(format), type, 0);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     
     //6. Attach texture to FBO color attachment
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fbo_render_texture, 0);
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
     {
         std::cerr << "Failed to construct FBO." << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteTextures(1, &fbo_render_texture);
+        glDeleteFramebuffers(1, &fboId);
+        fbo_render_texture = 0;
         return 0;
     }
 
@@ -188,4 +268,143 @@ inline void delete_fbo(GLuint fbo, GLuint fbo_render_texture)
 inline void bla() {
 }
 
+/**
+     Check if the current context exposes an extension
+     @param extension the extension name, e.g. "GL_OES_texture_half_float"
+     @return true if the extension is listed in GL_EXTENSIONS
+*/
+inline bool has_gl_extension(const char* extension)
+{
+    const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+    if (!extensions)
+        return false;
+    size_t length = strlen(extension);
+    for (const char* p = strstr(extensions, extension) ; p ; p = strstr(p + length, extension))
+    {
+        // Make sure we matched a whole name and not a prefix of a longer one
+        if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+            return true;
+    }
+    return false;
+}
+
+/**
+     Major version of the current context API, and whether it is OpenGL ES or desktop OpenGL.
+     @param es a reference set to true for an OpenGL ES context
+     @return the major version (e.g. 2 for "OpenGL ES 2.0", 4 for "4.5 (Core Profile) Mesa")
+*/
+inline int gl_major_version(bool &es)
+{
+    const char* version = (const char*)glGetString(GL_VERSION);
+    int major = 0;
+    es = version && strncmp(version, "OpenGL ES", 9) == 0;
+    if (version)
+        sscanf(es ? version + 9 : version, " %d", &major);
+    return major;
+}
+
+/**
+     Pixel transfer type for half floats on the current context.
+     Desktop OpenGL & OpenGL ES 3 use GL_HALF_FLOAT, OpenGL ES 2 needs GL_OES_texture_half_float.
+     @return the type to use, 0 if half floats are not supported
+*/
+inline GLenum half_float_type()
+{
+    bool es;
+    int major = gl_major_version(es);
+    if (!es || major >= 3)
+        return GL_HALF_FLOAT;
+    return has_gl_extension("GL_OES_texture_half_float") ? GL_HALF_FLOAT_OES : 0;
+}
+
+/**
+     Whether the current context renders into 32 bits float (GL_RGBA32F_EXT) targets.
+     Desktop OpenGL 3 does, OpenGL ES 3 needs GL_EXT_color_buffer_float, and GL_EXT_float_blend to blend into them.
+     @param blending true if the targets are also blended into
+     @return true if they are supported
+*/
+inline bool float_targets_supported(bool blending)
+{
+    bool es;
+    int major = gl_major_version(es);
+    if (!es)
+        return major >= 3;
+    return major >= 3 && has_gl_extension("GL_EXT_color_buffer_float")
+           && (!blending || has_gl_extension("GL_EXT_float_blend"));
+}
+
+/**
+     Channel layouts of the images exchanged with the GPU. OpenCV images are BGR, BGRA or single channel.
+*/
+enum PixelLayout
+{
+    PIXELS_RGB,
+    PIXELS_BGR,
+    PIXELS_RGBA,
+    PIXELS_BGRA,
+    PIXELS_GRAY // Sampled as (l, l, l, 1), the red channel of the result is read back
+};
+
+inline int layout_channels(PixelLayout layout)
+{
+    return layout == PIXELS_GRAY ? 1 : (layout == PIXELS_RGBA || layout == PIXELS_BGRA ? 4 : 3);
+}
+
+/**
+     Formats used to move a layout in & out of the GPU on the current context.
+     texture is the internal format of the input texture, target the one of the render targets.
+     upload & read are the glTexSubImage2D & glReadPixels formats, 0 when the driver cannot
+     transfer the layout as is: the data then has to be converted on the CPU from / to the
+     texture or target format.
+*/
+struct LayoutFormats
+{
+    GLenum texture, target, upload, read;
+};
+
+/**
+     Desktop OpenGL transfers BGR(A) & reads single channels natively, OpenGL ES needs
+     GL_EXT_texture_format_BGRA8888 & GL_EXT_read_format_bgra for BGRA and has no BGR.
+*/
+inline LayoutFormats layout_formats(PixelLayout layout)
+{
+    bool es;
+    gl_major_version(es);
+    LayoutFormats formats;
+    switch (layout)
+    {
+    case PIXELS_BGR:
+        formats.texture = formats.target = GL_RGB;
+        formats.upload = formats.read = es ? 0 : GL_BGR_EXT;
+        break;
+    case PIXELS_RGBA:
+        formats.texture = formats.target = formats.upload = formats.read = GL_RGBA;
+        break;
+    case PIXELS_BGRA:
+        formats.target = GL_RGBA;
+        if (!es)
+        {
+            formats.texture = GL_RGBA;
+            formats.upload = formats.read = GL_BGRA_EXT;
+        }
+        else
+        {
+            bool native = has_gl_extension("GL_EXT_texture_format_BGRA8888");
+            formats.texture = native ? GL_BGRA_EXT : GL_RGBA;
+            formats.upload = native ? GL_BGRA_EXT : 0;
+            formats.read = has_gl_extension("GL_EXT_read_format_bgra") ? GL_BGRA_EXT : 0;
+        }
+        break;
+    case PIXELS_GRAY:
+        formats.texture = formats.upload = GL_LUMINANCE;
+        formats.target = GL_RGB;
+        formats.read = es ? 0 : GL_RED_EXT;
+        break;
+    default:
+        formats.texture = formats.target = formats.upload = formats.read = GL_RGB;
+        break;
+    }
+    return formats;
+}
+
 #endif
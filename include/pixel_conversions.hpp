@@ -0,0 +1,75 @@
+#ifndef _PIXEL_CONVERSIONS_HPP_
+#define _PIXEL_CONVERSIONS_HPP_
+
+#include <cstddef>
+
+/**
+    Pixel format conversions into caller provided buffers: nothing is allocated, so the same
+    buffers can be reused frame after frame. They run in parallel on TileScheduler::global(),
+    and the 8 bits <-> float conversions are vectorised like the CPU filters (see cpu_simd_name()).
+    Source & destination must not overlap.
+*/
+
+/**
+    dst[i] = src[i] * scale, e.g. scale = 1 / 255 to normalise to [0, 1]
+    @param src the 8 bits samples
+    @param dst the float samples, size elements
+    @param size the number of samples
+    @param scale the factor applied to every sample
+*/
+void convert_uchar_to_float(const unsigned char* src, float* dst, size_t size, float scale = 1.f);
+
+/**
+    dst[i] = src[i] * scale, rounded to nearest (ties to even) & saturated to [0, 255]
+    @param src the float samples
+    @param dst the 8 bits samples, size elements
+    @param size the number of samples
+    @param scale the factor applied to every sample, e.g. 255 for samples in [0, 1]
+*/
+void convert_float_to_uchar(const float* src, unsigned char* dst, size_t size, float scale = 1.f);
+
+/**
+    Swap the first & third channels and convert to float in one pass, e.g. from an OpenCV BGR frame
+    to the RGB float input of a filter.
+    @param src the 3 channels 8 bits pixels
+    @param dst the 3 channels float pixels, 3 * pixels elements
+    @param pixels the number of pixels
+    @param scale the factor applied to every sample
+*/
+void convert_bgr_to_rgb_float(const unsigned char* src, float* dst, size_t pixels, float scale = 1.f);
+
+/**
+    gray = (r + g + b) / 3
+    @param src the RGB pixels
+    @param dst the gray pixels, pixels elements
+    @param pixels the number of pixels
+*/
+void convert_rgb_to_gray(const unsigned char* src, unsigned char* dst, size_t pixels);
+
+/**
+    gray = r, i.e. the first channel, as read back directly with GL_RED
+    @param src the RGB or RGBA pixels
+    @param dst the gray pixels, pixels elements
+    @param pixels the number of pixels
+    @param channels 3 or 4
+*/
+void convert_red_to_gray(const unsigned char* src, unsigned char* dst, size_t pixels, int channels);
+
+/**
+    r = g = b = gray
+    @param src the gray pixels
+    @param dst the RGB pixels, 3 * pixels elements
+    @param pixels the number of pixels
+*/
+void convert_gray_to_rgb(const unsigned char* src, unsigned char* dst, size_t pixels);
+
+/**
+    Swap the first & third channels, i.e. RGB <-> BGR or RGBA <-> BGRA
+    @param src the pixels
+    @param dst the swapped pixels, channels * pixels elements
+    @param pixels the number of pixels
+    @param channels 3 or 4
+*/
+void convert_swap_red_blue(const unsigned char* src, unsigned char* dst, size_t pixels, int channels);
+
+#endif
@@ -3,7 +3,10 @@
 
 #include <hiredis/hiredis.h>
 
-redisContext* redis_connect(std::string hostname, int port, bool timeout)
+#include <cstring>
+#include <string>
+
+inline redisContext* redis_connect(std::string hostname, int port, bool timeout)
 {
     redisContext* context;
     if (timeout)
@@ -18,49 +21,61 @@ redisContext* redis_connect(std::string hostname, int port, bool timeout)
     return context;
 }
 
-redisReply* redis_command(redisContext* context, std::string command)
+/**
+    Send a command & wait for its reply. The reply must be freed with freeReplyObject.
+*/
+inline redisReply* redis_command(redisContext* context, std::string command)
 {
     redisReply* reply = (redisReply*)redisCommand(context, command.c_str());
     return reply;
 }
 
-unsigned char* redis_reply_to_image(redisReply* reply, int width, int height, int channels)
+/**
+    Copy an image out of a GET reply.
+    @param reply the reply, left untouched
+    @param image the destination, must hold width * height * channels bytes
+    @return false if the reply is not a string of the expected size
+*/
+inline bool redis_reply_to_image(redisReply* reply, unsigned char* image, int width, int height, int channels)
 {
-    unsigned int size = width * height;
-    unsigned char* image  = new unsigned char[size * channels];
-    int cpt = 0;
-    for (int i = 0 ; i < size * 3; i++)
-    {
-        /*
-        if (i%4 == 0)
-        {
-            continue;
-        }
-        */
-        image[cpt++] = reply->str[i];
-    }
-    return image;
+    size_t size = (size_t)width * height * channels;
+    if (reply == NULL || reply->type != REDIS_REPLY_STRING || reply->len < size)
+        return false;
+    memcpy(image, reply->str, size);
+    return true;
 }
 
-unsigned char* redis_get_image(redisContext* context, std::string key, int width, int height)
+/**
+    GET an RGB image.
+    @return the image (to delete[]) or NULL if the key does not exist or has the wrong size
+*/
+inline unsigned char* redis_get_image(redisContext* context, std::string key, int width, int height)
 {
-    std::string command = "GET " + key;
-    redisReply* reply = redis_command(context, command);
-    if (reply->type == REDIS_REPLY_NIL)
-        return NULL;
-    return redis_reply_to_image(reply, width, height, 3);
+    redisReply* reply = (redisReply*)redisCommand(context, "GET %b", key.c_str(), (size_t)key.length());
+    unsigned char* image = new unsigned char[(size_t)width * height * 3];
+    if (!redis_reply_to_image(reply, image, width, height, 3))
+    {
+        delete[] image;
+        image = NULL;
+    }
+    if (reply)
+        freeReplyObject(reply);
+    return image;
 }
 
-void redis_set_image(redisContext* context, std::string key, unsigned char* image, int width, int height, int channel)
+/**
+    SET an image. The data is sent straight from the caller buffer.
+    @return true if the server acknowledged it
+*/
+inline bool redis_set_image(redisContext* context, std::string key, const unsigned char* image, int width, int height, int channel)
 {
-    int size = width * height * channel;
-    char* data = new char[size];
-    for (int i = 0 ; i < size ; i++)
-    {
-        data[i] = (char)image[i];
-    }
+    size_t size = (size_t)width * height * channel;
     // Use binary safe API to set image key
-    redisReply* reply = (redisReply*)redisCommand(context, "set %b %b", key.c_str(), (size_t) key.length(), data, size);
+    redisReply* reply = (redisReply*)redisCommand(context, "SET %b %b", key.c_str(), (size_t)key.length(), image, size);
+    bool ok = reply && reply->type != REDIS_REPLY_ERROR;
+    if (reply)
+        freeReplyObject(reply);
+    return ok;
 }
 
 #endif
@@ -0,0 +1,148 @@
+#ifndef _SIMD_HPP_
+#define _SIMD_HPP_
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+/*
+    Minimal SIMD layer: a vector of LANES floats that can be loaded from / stored to LANES
+    consecutive bytes or floats. The CPU filters & pixel conversions are written once on top of it,
+    for the instruction set the compiler targets (see CMakeLists.txt).
+*/
+namespace simd
+{
+/*
+    Saturate to [0, 255] (NaN gives 0), then round to nearest (ties to even), exactly like v_store_u8
+    does on every instruction set: scalar tails must give the same byte as the vector body for the same value.
+    The clamp comes first as lrint & cvtps both overflow to INT_MIN above 2^31.
+*/
+inline unsigned char round_u8(float v)
+{
+    v = v > 0.f ? (v < 255.f ? v : 255.f) : 0.f;
+    return (unsigned char)std::lrint(v);
+}
+
+#if defined(__AVX2__)
+
+const char* const SIMD_NAME = "AVX2";
+const int LANES = 8;
+typedef __m256 vfloat;
+
+inline vfloat v_set1(float f) { return _mm256_set1_ps(f); }
+inline vfloat v_add(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+inline vfloat v_sub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+inline vfloat v_mul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+inline vfloat v_sqrt(vfloat a) { return _mm256_sqrt_ps(a); }
+inline vfloat v_load_f32(const float* p) { return _mm256_loadu_ps(p); }
+inline void v_store_f32(float* p, vfloat v) { _mm256_storeu_ps(p, v); }
+inline vfloat v_load_u8(const unsigned char* p)
+{
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p)));
+}
+inline void v_store_u8(unsigned char* p, vfloat v)
+{
+    // max returns its second operand for NaN
+    v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(255.f));
+    __m256i i = _mm256_cvtps_epi32(v);
+    __m128i w = _mm_packs_epi32(_mm256_castsi256_si128(i), _mm256_extracti128_si256(i, 1));
+    _mm_storel_epi64((__m128i*)p, _mm_packus_epi16(w, w));
+}
+
+#elif defined(__SSE2__)
+
+const char* const SIMD_NAME = "SSE2";
+const int LANES = 4;
+typedef __m128 vfloat;
+
+inline vfloat v_set1(float f) { return _mm_set1_ps(f); }
+inline vfloat v_add(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+inline vfloat v_sub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+inline vfloat v_mul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+inline vfloat v_sqrt(vfloat a) { return _mm_sqrt_ps(a); }
+inline vfloat v_load_f32(const float* p) { return _mm_loadu_ps(p); }
+inline void v_store_f32(float* p, vfloat v) { _mm_storeu_ps(p, v); }
+inline vfloat v_load_u8(const unsigned char* p)
+{
+    int bytes;
+    memcpy(&bytes, p, sizeof(int));
+    __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+    return _mm_cvtepi32_ps(v);
+}
+inline void v_store_u8(unsigned char* p, vfloat v)
+{
+    // max returns its second operand for NaN
+    v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(255.f));
+    __m128i i = _mm_cvtps_epi32(v);
+    __m128i w = _mm_packs_epi32(i, i);
+    int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(w, w));
+    memcpy(p, &bytes, sizeof(int));
+}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+const char* const SIMD_NAME = "NEON";
+const int LANES = 4;
+typedef float32x4_t vfloat;
+
+inline vfloat v_set1(float f) { return vdupq_n_f32(f); }
+inline vfloat v_add(vfloat a, vfloat b) { return vaddq_f32(a, b); }
+inline vfloat v_sub(vfloat a, vfloat b) { return vsubq_f32(a, b); }
+inline vfloat v_mul(vfloat a, vfloat b) { return vmulq_f32(a, b); }
+inline vfloat v_load_f32(const float* p) { return vld1q_f32(p); }
+inline void v_store_f32(float* p, vfloat v) { vst1q_f32(p, v); }
+inline vfloat v_sqrt(vfloat a)
+{
+    // a * 1/sqrt(a), refined twice. sqrt(0) must stay 0.
+    float32x4_t e = vrsqrteq_f32(vmaxq_f32(a, vdupq_n_f32(1e-30f)));
+    e = vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(a, e), e));
+    e = vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(a, e), e));
+    return vmulq_f32(a, e);
+}
+inline vfloat v_load_u8(const unsigned char* p)
+{
+    uint32_t bytes;
+    memcpy(&bytes, p, sizeof(bytes));
+    uint16x8_t w = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(bytes)));
+    return vcvtq_f32_u32(vmovl_u16(vget_low_u16(w)));
+}
+inline void v_store_u8(unsigned char* p, vfloat v)
+{
+    // Saturate to [0, 255], then round to nearest even like cvtps: adding & removing 1.5 * 2^23 drops the fraction
+    const float32x4_t magic = vdupq_n_f32(12582912.f);
+    v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(0.f)), vdupq_n_f32(255.f));
+    int32x4_t i = vcvtq_s32_f32(vsubq_f32(vaddq_f32(v, magic), magic));
+    uint16x4_t w = vqmovun_s32(i);
+    uint8x8_t b = vqmovn_u16(vcombine_u16(w, w));
+    uint32_t bytes = vget_lane_u32(vreinterpret_u32_u8(b), 0);
+    memcpy(p, &bytes, sizeof(bytes));
+}
+
+#else
+
+const char* const SIMD_NAME = "scalar";
+const int LANES = 1;
+typedef float vfloat;
+
+inline vfloat v_set1(float f) { return f; }
+inline vfloat v_add(vfloat a, vfloat b) { return a + b; }
+inline vfloat v_sub(vfloat a, vfloat b) { return a - b; }
+inline vfloat v_mul(vfloat a, vfloat b) { return a * b; }
+inline vfloat v_sqrt(vfloat a) { return std::sqrt(a); }
+inline vfloat v_load_f32(const float* p) { return *p; }
+inline void v_store_f32(float* p, vfloat v) { *p = v; }
+inline vfloat v_load_u8(const unsigned char* p) { return *p; }
+inline void v_store_u8(unsigned char* p, vfloat v) { *p = round_u8(v); }
+
+#endif
+
+}
+
+#endif
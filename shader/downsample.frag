@@ -0,0 +1,20 @@
+#version 130
+
+/**
+    Downsampling Fragment Shader
+    Renders a source texture into a target of half its size (rounded up): each output pixel samples
+    the shared corner of its 2x2 source block, which GL_LINEAR turns into the average of the four
+    texels. The last column & row of an odd sized source are clamped to edge.
+*/
+
+#ifdef GL_ES
+precision mediump float;
+#endif
+
+uniform vec2 source_size;
+uniform sampler2D texture;
+
+void main() {
+    vec2 corner = 2.0 * floor(gl_FragCoord.xy) + 1.0;
+    gl_FragColor = vec4(texture2D(texture, corner / source_size).rgb, 1.0);
+}
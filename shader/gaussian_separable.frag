@@ -0,0 +1,40 @@
+#version 130
+
+/**
+    Separable Gaussian Blur Fragment Shader
+    One 1D pass of a gaussian blur of arbitrary radius, run once horizontally & once vertically.
+    Two neighbouring taps are merged into a single bilinear fetch placed between them,
+    offsets & weights are computed on the CPU (see GaussianBlur.hpp).
+    The source texture must be sampled with GL_LINEAR.
+*/
+
+#ifdef GL_ES
+precision mediump float;
+#endif
+
+// Must match GAUSSIAN_MAX_TAPS in GaussianBlur.hpp
+#define MAX_TAPS 32
+
+uniform int width;
+uniform int height;
+uniform sampler2D texture;
+
+uniform vec2 direction; // (1, 0) for the horizontal pass, (0, 1) for the vertical one
+uniform int taps;       // Number of used entries in offsets & weights, the first one is the center
+uniform float offsets[MAX_TAPS];
+uniform float weights[MAX_TAPS];
+
+void main() {
+    vec2 texcoord = vec2(gl_FragCoord.x/width, gl_FragCoord.y/height);
+    vec2 texel = direction / vec2(width, height);
+
+    vec3 sum = texture2D(texture, texcoord).rgb * weights[0];
+    for (int i = 1 ; i < MAX_TAPS ; ++i) {
+        if (i >= taps)
+            break;
+        vec2 offset = texel * offsets[i];
+        sum += texture2D(texture, texcoord + offset).rgb * weights[i];
+        sum += texture2D(texture, texcoord - offset).rgb * weights[i];
+    }
+    gl_FragColor = vec4(sum, 1.0);
+}
@@ -0,0 +1,14 @@
+#version 130
+
+/**
+    Histogram Fragment Shader
+    Counts one for the bin of the point drawn by histogram.vert, the target blends it additively.
+*/
+
+#ifdef GL_ES
+precision mediump float;
+#endif
+
+void main() {
+    gl_FragColor = vec4(1.0);
+}
@@ -0,0 +1,22 @@
+#version 130
+
+/**
+    Histogram Vertex Shader
+    Drawn as one point per sampled pixel, without any vertex attribute: gl_VertexID picks the pixel,
+    whose luma (BT.601) selects the bin, i.e. the column of a 256x1 target the point lands on.
+    With additive blending every point adds one to its bin (see histogram.frag).
+*/
+
+uniform sampler2D texture;
+uniform int width;  // Pixels of the texture
+uniform int height;
+uniform int step;   // Every step-th pixel of every step-th row is sampled
+
+void main() {
+    int columns = (width + step - 1) / step;
+    ivec2 pixel = ivec2(gl_VertexID % columns, gl_VertexID / columns) * step;
+    float luma = dot(texelFetch(texture, pixel, 0).rgb, vec3(0.299, 0.587, 0.114));
+    float bin = floor(luma * 255.0 + 0.5);
+    gl_Position = vec4((bin + 0.5) / 128.0 - 1.0, 0.0, 0.0, 1.0);
+    gl_PointSize = 1.0;
+}
@@ -0,0 +1,45 @@
+#version 130
+
+/**
+    Reduction Fragment Shader
+    Renders a source texture into a target 4 times smaller (rounded up): each output pixel is the
+    minimum, maximum or mean of its 4x4 source block. A source texel stands for block x block pixels
+    of the image, fewer on the last column & row when the image size is not a multiple of it, so the
+    mean weights each texel by the pixels it covers. Texels past the edge weigh nothing and read the
+    last ones (clamped to edge), which leaves min & max unchanged: the loop needs no branch.
+*/
+
+#ifdef GL_ES
+#ifdef GL_FRAGMENT_PRECISION_HIGH
+precision highp float;
+#else
+precision mediump float;
+#endif
+#endif
+
+uniform vec2 source_size; // Texels of the source
+uniform vec2 image_size;  // Pixels of the reduced image
+uniform float block;      // Pixels of the image per source texel along each axis
+uniform int operation;    // 0: min, 1: max, 2: mean
+uniform sampler2D texture;
+
+void main() {
+    vec2 first = 4.0 * floor(gl_FragCoord.xy);
+    vec3 low = vec3(1.0);
+    vec3 high = vec3(0.0);
+    vec3 sum = vec3(0.0);
+    float total = 0.0;
+    for (int y = 0 ; y < 4 ; ++y) {
+        for (int x = 0 ; x < 4 ; ++x) {
+            vec2 texel = first + vec2(x, y);
+            vec2 covered = clamp(image_size - texel * block, 0.0, block);
+            float weight = covered.x * covered.y;
+            vec3 value = texture2D(texture, (texel + 0.5) / source_size).rgb;
+            low = min(low, value);
+            high = max(high, value);
+            sum += value * weight;
+            total += weight;
+        }
+    }
+    gl_FragColor = vec4(operation == 0 ? low : (operation == 1 ? high : sum / total), 1.0);
+}
@@ -0,0 +1,38 @@
+#version 130
+
+/**
+    YUV to RGB Fragment Shader
+    Converts a camera frame uploaded as separate planes (BT.601, video range) so that the filter
+    chain gets RGB without any CPU colour conversion. The chroma planes are half resolution.
+    I420: y_plane, u_plane & v_plane are single channel.
+    NV12: u_plane holds the interleaved UV samples as luminance & alpha, v_plane is unused.
+*/
+
+#ifdef GL_ES
+precision mediump float;
+#endif
+
+uniform int width;
+uniform int height;
+uniform sampler2D y_plane;
+uniform sampler2D u_plane;
+uniform sampler2D v_plane;
+uniform int interleaved;
+
+void main() {
+    vec2 texcoord = vec2(gl_FragCoord.x/width, gl_FragCoord.y/height);
+
+    float y = texture2D(y_plane, texcoord).r;
+    vec2 uv;
+    if (interleaved == 1)
+        uv = texture2D(u_plane, texcoord).ra;
+    else
+        uv = vec2(texture2D(u_plane, texcoord).r, texture2D(v_plane, texcoord).r);
+
+    y = 1.164383 * (y - 0.0625);
+    uv -= 0.5;
+    gl_FragColor = vec4(y + 1.596027 * uv.y,
+                        y - 0.391762 * uv.x - 0.812968 * uv.y,
+                        y + 2.017232 * uv.x,
+                        1.0);
+}
@@ -0,0 +1,138 @@
+#include "AsyncReadback.hpp"
+#include "gles_utils.hpp"
+
+#include <cstdlib>
+
+// OpenGL ES 3.0 enums, not part of the OpenGL ES 2 headers
+#define PIXEL_PACK_BUFFER 0x88EB
+#define STREAM_READ 0x88E1
+#define MAP_READ_BIT 0x0001
+#define SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#define ALREADY_SIGNALED 0x911A
+#define CONDITION_SATISFIED 0x911C
+#define TIMEOUT_IGNORED 0xFFFFFFFFFFFFFFFFULL
+
+AsyncReadback::AsyncReadback()
+    : m_map_buffer_range(NULL), m_unmap_buffer(NULL), m_fence_sync(NULL),
+      m_client_wait_sync(NULL), m_delete_sync(NULL)
+{
+}
+
+AsyncReadback::~AsyncReadback()
+{
+    // Buffers & fences belong to the GL context, the owner calls release() while it is still current.
+}
+
+bool AsyncReadback::init()
+{
+    const char* disabled = getenv("IPOGLES_NO_PBO");
+    if (disabled && atoi(disabled) != 0)
+        return false;
+
+    // Pixel pack buffers & map buffer range come with OpenGL ES 3.0 / OpenGL 3.0, fences with OpenGL 3.2
+    bool es;
+    int major = gl_major_version(es);
+    if (!(es ? major >= 3 : (major >= 4 || has_gl_extension("GL_ARB_sync"))))
+        return false;
+
+    m_map_buffer_range = (void* (*)(GLenum, GLintptr, GLsizeiptr, GLbitfield))eglGetProcAddress("glMapBufferRange");
+    m_unmap_buffer = (GLboolean (*)(GLenum))eglGetProcAddress("glUnmapBuffer");
+    m_fence_sync = (GLsync (*)(GLenum, GLbitfield))eglGetProcAddress("glFenceSync");
+    m_client_wait_sync = (GLenum (*)(GLsync, GLbitfield, unsigned long long))eglGetProcAddress("glClientWaitSync");
+    m_delete_sync = (void (*)(GLsync))eglGetProcAddress("glDeleteSync");
+    if (!m_map_buffer_range || !m_unmap_buffer || !m_fence_sync || !m_client_wait_sync || !m_delete_sync)
+    {
+        m_map_buffer_range = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool AsyncReadback::start(int index, const RenderTarget& target, GLenum type)
+{
+    if (!available())
+        return false;
+    if ((int)m_buffers.size() <= index)
+    {
+        Buffer none = { 0, 0, 0, NULL };
+        m_buffers.resize(index + 1, none);
+    }
+    Buffer& buffer = m_buffers[index];
+    if (buffer.fence)
+    {
+        std::cerr << "Readback buffer " << index << " is still pending." << std::endl;
+        return false;
+    }
+
+    //1. Make room for the image, the storage is kept between frames of the same size
+    GLsizeiptr channel_size = type == GL_FLOAT ? 4 : (type == GL_UNSIGNED_BYTE ? 1 : 2);
+    buffer.size = (GLsizeiptr)target.width * target.height * 3 * channel_size;
+    if (!buffer.pbo)
+        glGenBuffers(1, &buffer.pbo);
+    glBindBuffer(PIXEL_PACK_BUFFER, buffer.pbo);
+    if (buffer.capacity < buffer.size)
+    {
+        glBufferData(PIXEL_PACK_BUFFER, buffer.size, NULL, STREAM_READ);
+        buffer.capacity = buffer.size;
+    }
+
+    //2. With a pack buffer bound, glReadPixels takes an offset & returns without waiting for the GPU
+    glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, target.width, target.height, GL_RGB, type, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindBuffer(PIXEL_PACK_BUFFER, 0);
+
+    //3. Signaled once the copy is done
+    buffer.fence = m_fence_sync(SYNC_GPU_COMMANDS_COMPLETE, 0);
+    return buffer.fence != NULL;
+}
+
+bool AsyncReadback::poll(int index)
+{
+    if (index >= (int)m_buffers.size() || !m_buffers[index].fence)
+        return false;
+    GLenum status = m_client_wait_sync(m_buffers[index].fence, SYNC_FLUSH_COMMANDS_BIT, 0);
+    return status == ALREADY_SIGNALED || status == CONDITION_SATISFIED;
+}
+
+bool AsyncReadback::finish(int index, void* dst)
+{
+    if (index >= (int)m_buffers.size() || !m_buffers[index].fence)
+        return false;
+    Buffer& buffer = m_buffers[index];
+
+    //1. Wait for the copy (returns at once if poll() already saw it done)
+    GLenum status = m_client_wait_sync(buffer.fence, SYNC_FLUSH_COMMANDS_BIT, TIMEOUT_IGNORED);
+    m_delete_sync(buffer.fence);
+    buffer.fence = NULL;
+    if (status != ALREADY_SIGNALED && status != CONDITION_SATISFIED)
+    {
+        std::cerr << "Failed to wait for readback " << index << "." << std::endl;
+        return false;
+    }
+
+    //2. Map only now, mapping a buffer the GPU still writes would stall right here
+    glBindBuffer(PIXEL_PACK_BUFFER, buffer.pbo);
+    void* pixels = m_map_buffer_range(PIXEL_PACK_BUFFER, 0, buffer.size, MAP_READ_BIT);
+    if (pixels)
+    {
+        memcpy(dst, pixels, buffer.size);
+        m_unmap_buffer(PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(PIXEL_PACK_BUFFER, 0);
+    return pixels != NULL;
+}
+
+void AsyncReadback::release()
+{
+    for (size_t i = 0 ; i < m_buffers.size() ; ++i)
+    {
+        if (m_buffers[i].fence)
+            m_delete_sync(m_buffers[i].fence);
+        if (m_buffers[i].pbo)
+            glDeleteBuffers(1, &m_buffers[i].pbo);
+    }
+    m_buffers.clear();
+}
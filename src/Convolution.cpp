@@ -0,0 +1,272 @@
+#include "Convolution.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+int count_taps(const std::vector<float>& weights, int cols, int rows)
+{
+    std::vector<ConvolutionTap> taps;
+    convolution_taps(weights, cols, rows, true, taps);
+    return (int)taps.size();
+}
+
+bool has_fractional_tap(const std::vector<ConvolutionTap>& taps)
+{
+    for (size_t i = 0 ; i < taps.size() ; ++i)
+        if (taps[i].x != std::floor(taps[i].x) || taps[i].y != std::floor(taps[i].y))
+            return true;
+    return false;
+}
+
+bool add_convolution_pass(GpuFilterContext& gpu, const std::string& vertex_shader_path,
+                          const std::vector<float>& weights, int cols, int rows)
+{
+    std::vector<ConvolutionTap> taps;
+    convolution_taps(weights, cols, rows, true, taps);
+    FilterPass* pass = gpu.add_pass_source(vertex_shader_path, convolution_shader_source(taps), std::max(cols, rows) / 2);
+    if (!pass)
+        return false;
+    pass->linear = has_fractional_tap(taps);
+    return true;
+}
+}
+
+std::string glsl_float(float value)
+{
+    // Shortest literal giving back the same float, always with a '.' or an exponent as GLSL requires
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.9g", value);
+    std::string literal = buffer;
+    if (literal.find_first_of(".en") == std::string::npos)
+        literal += ".0";
+    return literal;
+}
+
+void convolution_taps(const std::vector<float>& weights, int cols, int rows, bool merge, std::vector<ConvolutionTap> &taps)
+{
+    taps.clear();
+    // A single column kernel is merged vertically, any other one along its rows
+    bool vertical = cols == 1;
+    int lines = vertical ? 1 : rows, length = vertical ? rows : cols;
+    for (int line = 0 ; line < lines ; ++line)
+    {
+        for (int i = 0 ; i < length ; ++i)
+        {
+            float weight = weights[vertical ? i : line * cols + i];
+            if (weight == 0.f)
+                continue;
+            float offset = (float)(i - length / 2);
+
+            // Taps i & i+1 of the same sign are replaced by one fetch placed so that bilinear filtering gives each one its own weight
+            float next = i + 1 < length ? weights[vertical ? i + 1 : line * cols + i + 1] : 0.f;
+            if (merge && next != 0.f && (next > 0.f) == (weight > 0.f))
+            {
+                offset = (offset * weight + (offset + 1.f) * next) / (weight + next);
+                weight += next;
+                ++i;
+            }
+
+            ConvolutionTap tap;
+            tap.x = vertical ? 0.f : offset;
+            tap.y = vertical ? offset : (float)(line - rows / 2);
+            tap.weight = weight;
+            taps.push_back(tap);
+        }
+    }
+}
+
+bool convolution_separate(const std::vector<float>& weights, int cols, int rows,
+                          std::vector<float> &column, std::vector<float> &row, bool &row_first)
+{
+    //1. The row & column of the largest weight give both factors of a rank 1 kernel
+    size_t pivot = 0;
+    for (size_t i = 1 ; i < weights.size() ; ++i)
+        if (std::fabs(weights[i]) > std::fabs(weights[pivot]))
+            pivot = i;
+    float largest = weights[pivot];
+    if (largest == 0.f)
+        return false;
+    int pivot_row = (int)pivot / cols, pivot_col = (int)pivot % cols;
+    row.assign(weights.begin() + pivot_row * cols, weights.begin() + (pivot_row + 1) * cols);
+    column.resize(rows);
+    for (int y = 0 ; y < rows ; ++y)
+        column[y] = weights[y * cols + pivot_col] / largest;
+
+    //2. It is one if every weight is the product of its factors
+    for (int y = 0 ; y < rows ; ++y)
+        for (int x = 0 ; x < cols ; ++x)
+            if (std::fabs(column[y] * row[x] - weights[y * cols + x]) > 1e-5f * std::fabs(largest))
+                return false;
+
+    //3. The factor applied first must keep the intermediate image in [0, 1]
+    bool row_positive = true, column_positive = true, row_negative = true, column_negative = true;
+    float row_sum = 0.f, column_sum = 0.f;
+    for (int x = 0 ; x < cols ; ++x)
+    {
+        row_positive &= row[x] >= 0.f;
+        row_negative &= row[x] <= 0.f;
+        row_sum += row[x];
+    }
+    for (int y = 0 ; y < rows ; ++y)
+    {
+        column_positive &= column[y] >= 0.f;
+        column_negative &= column[y] <= 0.f;
+        column_sum += column[y];
+    }
+    std::vector<float>* first;
+    std::vector<float>* second;
+    float sum;
+    if (row_positive || row_negative)
+    {
+        row_first = true;
+        first = &row;
+        second = &column;
+        sum = row_sum;
+    }
+    else if (column_positive || column_negative)
+    {
+        row_first = false;
+        first = &column;
+        second = &row;
+        sum = column_sum;
+    }
+    else
+        return false;
+
+    // Moving the sum (sign included) to the second factor normalizes the first one
+    for (size_t i = 0 ; i < first->size() ; ++i)
+        (*first)[i] /= sum;
+    for (size_t i = 0 ; i < second->size() ; ++i)
+        (*second)[i] *= sum;
+    return true;
+}
+
+std::string convolution_sum_source(const std::vector<ConvolutionTap>& taps, const std::string& position, const std::string& indent)
+{
+    std::ostringstream source;
+    for (size_t i = 0 ; i < taps.size() ; ++i)
+    {
+        const ConvolutionTap& tap = taps[i];
+        std::string fetch = "texture2D(texture, " + position;
+        if (tap.x != 0.f || tap.y != 0.f)
+            fetch += " + texel * vec2(" + glsl_float(tap.x) + ", " + glsl_float(tap.y) + ")";
+        fetch += ").rgb";
+
+        if (tap.weight == 1.f || tap.weight == -1.f)
+            source << indent << "sum " << (tap.weight > 0.f ? "+" : "-") << "= " << fetch << ";\n";
+        else
+            source << indent << "sum += " << fetch << " * " << glsl_float(tap.weight) << ";\n";
+    }
+    return source.str();
+}
+
+std::string convolution_shader_source(const std::vector<ConvolutionTap>& taps)
+{
+    std::ostringstream source;
+    source << "#version 130\n"
+              "\n"
+              "/**\n"
+              "    Convolution Fragment Shader, generated by convolution_shader_source() (" << taps.size() << " fetches)\n"
+              "*/\n"
+              "\n"
+              "#ifdef GL_ES\n"
+              "precision mediump float;\n"
+              "#endif\n"
+              "\n"
+              "uniform int width;\n"
+              "uniform int height;\n"
+              "uniform sampler2D texture;\n"
+              "\n"
+              "void main() {\n"
+              "    vec2 texel = 1.0 / vec2(width, height);\n"
+              "    vec2 texcoord = gl_FragCoord.xy * texel;\n"
+              "    vec3 sum = vec3(0.0);\n";
+    source << convolution_sum_source(taps, "texcoord", "    ");
+    source << "    gl_FragColor = vec4(sum, 1.0);\n"
+              "}\n";
+    return source.str();
+}
+
+bool add_convolution(GpuFilterContext& gpu, const std::string& vertex_shader_path, const std::vector<float>& weights,
+                     int cols, int rows, ConvolutionHint hint)
+{
+    if (cols < 1 || rows < 1 || cols % 2 == 0 || rows % 2 == 0 || weights.size() != (size_t)cols * rows) {
+        std::cerr << "Convolution kernels must have an odd size & rows * cols weights (got "
+                  << cols << "x" << rows << ", " << weights.size() << " weights)." << std::endl;
+        return false;
+    }
+
+    //1. Two 1D passes when the kernel allows it & that saves fetches
+    std::vector<float> column, row;
+    bool row_first = true;
+    if (hint != CONVOLUTION_SINGLE_PASS && cols > 1 && rows > 1)
+    {
+        bool separable = convolution_separate(weights, cols, rows, column, row, row_first);
+        if (!separable && hint == CONVOLUTION_SEPARABLE)
+            std::cerr << "Warning: the " << cols << "x" << rows << " kernel is not separable, it runs in a single pass." << std::endl;
+        // The intermediate image is rounded to 8 bits, a second factor of gain above 1 would amplify that error
+        float gain = 0.f;
+        const std::vector<float>& second = row_first ? column : row;
+        for (size_t i = 0 ; separable && i < second.size() ; ++i)
+            gain += std::fabs(second[i]);
+        if (separable && (hint == CONVOLUTION_SEPARABLE || (gain <= 1.f + 1e-5f
+                          && count_taps(row, cols, 1) + count_taps(column, 1, rows) < count_taps(weights, cols, rows))))
+        {
+            if (row_first)
+                return add_convolution_pass(gpu, vertex_shader_path, row, cols, 1)
+                       && add_convolution_pass(gpu, vertex_shader_path, column, 1, rows);
+            return add_convolution_pass(gpu, vertex_shader_path, column, 1, rows)
+                   && add_convolution_pass(gpu, vertex_shader_path, row, cols, 1);
+        }
+    }
+
+    //2. One pass over every non zero weight
+    return add_convolution_pass(gpu, vertex_shader_path, weights, cols, rows);
+}
+
+bool parse_convolution_kernel(const std::string& spec, std::vector<float> &weights, int &cols, int &rows)
+{
+    weights.clear();
+    cols = rows = 0;
+    size_t divisor_pos = spec.find(':');
+    float divisor = divisor_pos == std::string::npos ? 1.f : (float)atof(spec.c_str() + divisor_pos + 1);
+    std::string matrix = spec.substr(0, divisor_pos);
+    if (divisor == 0.f)
+        return false;
+
+    std::istringstream lines(matrix);
+    std::string line;
+    while (std::getline(lines, line, '/'))
+    {
+        std::istringstream values(line);
+        std::string value;
+        int count = 0;
+        while (std::getline(values, value, ','))
+        {
+            char* end;
+            float weight = (float)strtod(value.c_str(), &end);
+            if (end == value.c_str())
+                return false;
+            weights.push_back(weight / divisor);
+            ++count;
+        }
+        if (rows > 0 && count != cols)
+            return false;
+        cols = count;
+        ++rows;
+    }
+    if (rows == 0 || cols == 0)
+        return false;
+    // Kernels are centered on their middle weight, see add_convolution()
+    if (cols % 2 == 0 || rows % 2 == 0) {
+        std::cerr << "Convolution kernels must have an odd size (got " << cols << "x" << rows << ")." << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,272 @@
+#include "FilterFusion.hpp"
+#include "Convolution.hpp"
+#include "cpu_filters.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace
+{
+// Weights of shader/sobel.frag, row by row from the top
+const float SOBEL_H[9] = { -1.f, 0.f, 1.f,  -2.f, 0.f, 2.f,  -1.f, 0.f, 1.f };
+const float SOBEL_V[9] = {  1.f, 2.f, 1.f,   0.f, 0.f, 0.f,  -1.f, -2.f, -1.f };
+
+FilterStage sobel_kernel(const float* weights)
+{
+    return convolution_stage(std::vector<float>(weights, weights + 9), 3, 3);
+}
+
+// A convolution that cannot take values out of [0, 1], so skipping its 8 bits target changes nothing but rounding
+bool stays_in_range(const FilterStage& stage)
+{
+    float sum = 0.f;
+    for (size_t i = 0 ; i < stage.weights.size() ; ++i)
+    {
+        if (stage.weights[i] < 0.f)
+            return false;
+        sum += stage.weights[i];
+    }
+    return sum <= 1.f + 1e-4f;
+}
+
+// Fetches of a stage run alone with its own shader, the center texel read by sobel.frag is unused
+int stage_fetches(const FilterStage& stage)
+{
+    if (stage.type == STAGE_SOBEL)
+        return 8;
+    if (!stage.shader_path.empty())
+        return stage.cols * stage.rows;
+    std::vector<ConvolutionTap> taps;
+    convolution_taps(stage.weights, stage.cols, stage.rows, true, taps);
+    return (int)taps.size();
+}
+
+// Identity kernel, the start of a group
+FilterStage identity()
+{
+    return convolution_stage(std::vector<float>(1, 1.f), 1, 1);
+}
+
+bool add_group(GpuFilterContext& gpu, const std::string& vertex_shader_path,
+               const std::vector<FilterStage>& stages, size_t begin, size_t end)
+{
+    //1. A stage alone keeps its own shader
+    if (end - begin == 1)
+    {
+        const FilterStage& stage = stages[begin];
+        if (!stage.shader_path.empty())
+            return gpu.add_pass(vertex_shader_path, stage.shader_path) != NULL;
+        return add_convolution(gpu, vertex_shader_path, stage.weights, stage.cols, stage.rows);
+    }
+
+    //2. Fused stages run one generated pass
+    std::vector<FilterStage> group(stages.begin() + begin, stages.begin() + end);
+    int fetches, radius = 0, border = 0;
+    for (size_t i = 0 ; i < group.size() ; ++i)
+    {
+        radius += std::max(group[i].cols, group[i].rows) / 2;
+        // Only the stages after the first one can read intermediate values out of the image
+        border += i > 0 ? std::max(group[i].cols, group[i].rows) / 2 : 0;
+    }
+    FilterPass* pass = gpu.add_pass_source(vertex_shader_path, fused_shader_source(group, false, fetches), radius);
+    return pass && gpu.set_border_program(*pass, vertex_shader_path, fused_shader_source(group, true, fetches), border);
+}
+}
+
+bool filter_stage_from_shader(const std::string& fragment_shader_path, FilterStage &stage)
+{
+    CpuFilter filter;
+    if (!cpu_filter_from_shader(fragment_shader_path, filter))
+        return false;
+    int size = 2 * cpu_filter_radius(filter) + 1;
+    const float* kernel = cpu_filter_kernel(filter);
+    stage.type = kernel ? STAGE_CONVOLUTION : STAGE_SOBEL;
+    stage.cols = stage.rows = size;
+    if (kernel)
+        stage.weights.assign(kernel, kernel + size * size);
+    stage.shader_path = fragment_shader_path;
+    return true;
+}
+
+FilterStage convolution_stage(const std::vector<float>& weights, int cols, int rows)
+{
+    FilterStage stage;
+    stage.type = STAGE_CONVOLUTION;
+    stage.weights = weights;
+    stage.cols = cols;
+    stage.rows = rows;
+    return stage;
+}
+
+void compose_kernels(const FilterStage& first, const FilterStage& second, FilterStage &kernel)
+{
+    // Applying a at offset d then b at offset e reads the source at d + e
+    std::vector<float> weights((first.cols + second.cols - 1) * (first.rows + second.rows - 1), 0.f);
+    int cols = first.cols + second.cols - 1;
+    for (int ay = 0 ; ay < first.rows ; ++ay)
+        for (int ax = 0 ; ax < first.cols ; ++ax)
+            for (int by = 0 ; by < second.rows ; ++by)
+                for (int bx = 0 ; bx < second.cols ; ++bx)
+                    weights[(ay + by) * cols + ax + bx] += first.weights[ay * first.cols + ax] * second.weights[by * second.cols + bx];
+    kernel = convolution_stage(weights, cols, first.rows + second.rows - 1);
+}
+
+std::string fused_shader_source(const std::vector<FilterStage>& stages, bool borders, int &fetches)
+{
+    bool sobel = stages.back().type == STAGE_SOBEL;
+    size_t convolutions = stages.size() - (sobel ? 1 : 0);
+    FilterStage kernel = identity();
+    for (size_t i = 0 ; i < convolutions ; ++i)
+        compose_kernels(kernel, stages[i], kernel);
+
+    std::ostringstream source;
+    source << "#version 130\n"
+              "\n"
+              "/**\n"
+              "    Fused Fragment Shader, generated by fused_shader_source() (" << stages.size() << " stages"
+           << (borders ? ", borders" : "") << ")\n"
+              "*/\n"
+              "\n"
+              "#ifdef GL_ES\n"
+              "precision mediump float;\n"
+              "#endif\n"
+              "\n"
+              "uniform int width;\n"
+              "uniform int height;\n"
+              "uniform sampler2D texture;\n"
+              "\n"
+              "vec2 texel;\n"
+              "vec2 low;  // Center of the first texel\n"
+              "vec2 high; // Center of the last texel\n";
+
+    //1. Near the borders each stage clamps its own reads to edge, exactly like separate passes would:
+    // stage<i>() evaluates the first i convolutions at a texture coordinate, one stage at a time.
+    std::vector<ConvolutionTap> taps;
+    for (size_t i = 0 ; borders && i < convolutions ; ++i)
+    {
+        const FilterStage& stage = stages[i];
+        source << "\nvec3 stage" << i + 1 << "(vec2 p) {\n"
+                  "    vec3 sum = vec3(0.0);\n";
+        convolution_taps(stage.weights, stage.cols, stage.rows, false, taps);
+        if (i == 0)
+            source << convolution_sum_source(taps, "p", "    ");
+        for (size_t t = 0 ; i > 0 && t < taps.size() ; ++t)
+            source << "    sum += stage" << i << "(clamp(p + texel * vec2(" << glsl_float(taps[t].x) << ", "
+                   << glsl_float(taps[t].y) << "), low, high)) * " << glsl_float(taps[t].weight) << ";\n";
+        source << "    return sum;\n"
+                  "}\n";
+    }
+
+    source << "\n"
+              "void main() {\n"
+              "    texel = 1.0 / vec2(width, height);\n"
+              "    low = 0.5 * texel;\n"
+              "    high = 1.0 - 0.5 * texel;\n"
+              "    vec2 texcoord = gl_FragCoord.xy * texel;\n";
+    if (sobel)
+        source << "    float sobel_h = 0.0;\n"
+                  "    float sobel_v = 0.0;\n"
+                  "    float gray;\n";
+    else
+        source << "    vec3 sum = vec3(0.0);\n";
+
+    fetches = 0;
+    if (borders && sobel)
+    {
+        for (int i = 0 ; i < 9 ; ++i)
+        {
+            if (SOBEL_H[i] == 0.f && SOBEL_V[i] == 0.f)
+                continue;
+            source << "    gray = dot(stage" << convolutions << "(clamp(texcoord + texel * vec2("
+                   << glsl_float((float)(i % 3 - 1)) << ", " << glsl_float((float)(i / 3 - 1)) << "), low, high)), vec3(1.0));\n";
+            if (SOBEL_H[i] != 0.f)
+                source << "    sobel_h += gray * " << glsl_float(SOBEL_H[i] / 3.f) << ";\n";
+            if (SOBEL_V[i] != 0.f)
+                source << "    sobel_v += gray * " << glsl_float(SOBEL_V[i] / 3.f) << ";\n";
+        }
+    }
+    else if (borders)
+        source << "    sum = stage" << convolutions << "(texcoord);\n";
+
+    //2. Inside, the composite kernel reads the source directly
+    else if (sobel)
+    {
+        // Both gradients are taken through the composite kernels sobel * kernel, each texel is fetched
+        // once & feeds both, the / 3 of the gray level is folded into the weights
+        FilterStage horizontal, vertical;
+        compose_kernels(kernel, sobel_kernel(SOBEL_H), horizontal);
+        compose_kernels(kernel, sobel_kernel(SOBEL_V), vertical);
+        float epsilon = 1e-6f * *std::max_element(horizontal.weights.begin(), horizontal.weights.end());
+        for (int y = 0 ; y < horizontal.rows ; ++y)
+        {
+            for (int x = 0 ; x < horizontal.cols ; ++x)
+            {
+                float h = horizontal.weights[y * horizontal.cols + x] / 3.f, v = vertical.weights[y * vertical.cols + x] / 3.f;
+                if (std::fabs(h) <= epsilon && std::fabs(v) <= epsilon)
+                    continue;
+                source << "    gray = dot(texture2D(texture, texcoord + texel * vec2("
+                       << glsl_float((float)(x - horizontal.cols / 2)) << ", " << glsl_float((float)(y - horizontal.rows / 2))
+                       << ")).rgb, vec3(1.0));\n";
+                if (std::fabs(h) > epsilon)
+                    source << "    sobel_h += gray * " << glsl_float(h) << ";\n";
+                if (std::fabs(v) > epsilon)
+                    source << "    sobel_v += gray * " << glsl_float(v) << ";\n";
+                ++fetches;
+            }
+        }
+    }
+    else
+    {
+        // Taps are not merged into bilinear fetches: the fetch count stays exact & comparable to the unfused shaders
+        convolution_taps(kernel.weights, kernel.cols, kernel.rows, false, taps);
+        source << convolution_sum_source(taps, "texcoord", "    ");
+        fetches = (int)taps.size();
+    }
+
+    if (sobel)
+        source << "    gl_FragColor = vec4(vec3(1.0 - sqrt(sobel_h * sobel_h + sobel_v * sobel_v)), 1.0);\n";
+    else
+        source << "    gl_FragColor = vec4(sum, 1.0);\n";
+    source << "}\n";
+    return source.str();
+}
+
+bool add_filter_stages(GpuFilterContext& gpu, const std::string& vertex_shader_path, const std::vector<FilterStage>& stages)
+{
+    // Greedy grouping: a stage joins the current group while the fused pass is estimated cheaper than
+    // the group & the stage run separately. Sobel ends a group, its output is not linear.
+    size_t begin = 0;
+    FilterStage kernel; // Composite of the convolutions of the group
+    int group_cost = 0;
+    for (size_t i = 0 ; i < stages.size() ; ++i)
+    {
+        const FilterStage& stage = stages[i];
+        if (i > begin)
+        {
+            if (stages[i - 1].type == STAGE_CONVOLUTION && stays_in_range(kernel))
+            {
+                std::vector<FilterStage> group(stages.begin() + begin, stages.begin() + i + 1);
+                int fused_cost;
+                fused_shader_source(group, false, fused_cost);
+                if (fused_cost <= group_cost + stage_fetches(stage) + FUSION_PASS_COST)
+                {
+                    if (stage.type == STAGE_CONVOLUTION)
+                        compose_kernels(kernel, stage, kernel);
+                    group_cost = fused_cost;
+                    continue;
+                }
+            }
+
+            //1. Not worth it (or not possible): the group so far becomes a pass of its own
+            if (!add_group(gpu, vertex_shader_path, stages, begin, i))
+                return false;
+            begin = i;
+        }
+
+        //2. The stage starts a new group
+        kernel = stage;
+        group_cost = stage_fetches(stage);
+    }
+    return stages.empty() || add_group(gpu, vertex_shader_path, stages, begin, stages.size());
+}
@@ -0,0 +1,130 @@
+#include "FramePipeline.hpp"
+
+#include <iostream>
+
+FramePipeline::FramePipeline(GpuFilterContext& gpu, int depth)
+    : m_gpu(gpu), m_submitted(0), m_received(0)
+{
+    if (depth < 1)
+        depth = 1;
+    const RenderTarget none = { 0, 0, 0, 0, GL_RGB, GL_UNSIGNED_BYTE };
+    Slot slot;
+    slot.input = slot.targets[0] = slot.targets[1] = none;
+    slot.result = 0;
+    slot.queued = false;
+    m_slots.assign(depth, slot);
+    m_readback.init();
+}
+
+FramePipeline::~FramePipeline()
+{
+    for (size_t i = 0 ; i < m_slots.size() ; ++i)
+        release(m_slots[i]);
+    m_readback.release();
+}
+
+void FramePipeline::release(Slot& slot)
+{
+    m_gpu.pool().release(slot.input);
+    m_gpu.pool().release(slot.targets[0]);
+    m_gpu.pool().release(slot.targets[1]);
+    slot.input.texture = slot.input.fbo = slot.targets[0].fbo = slot.targets[0].texture = slot.targets[1].fbo = slot.targets[1].texture = 0;
+}
+
+FramePipeline::Slot* FramePipeline::prepare(int width, int height, bool yuv)
+{
+    if (m_gpu.pass_count() == 0) {
+        std::cerr << "No shader program loaded." << std::endl;
+        return NULL;
+    }
+    if (in_flight() == depth()) {
+        std::cerr << "Frame pipeline is full, receive() a frame first." << std::endl;
+        return NULL;
+    }
+
+    // (Re)acquire the slot resources when the stream changes size, a steady stream never allocates.
+    // YUV frames are converted into the input, which is then a render target.
+    Slot& slot = m_slots[m_submitted % m_slots.size()];
+    bool two_targets = m_gpu.pass_count() > 1;
+    if (slot.input.width != width || slot.input.height != height || !slot.input.texture
+        || (yuv && !slot.input.fbo) || (two_targets && !slot.targets[1].fbo))
+    {
+        release(slot);
+        slot.input = yuv ? m_gpu.pool().acquire_target(width, height) : m_gpu.pool().acquire_texture(width, height);
+        slot.targets[0] = m_gpu.pool().acquire_target(width, height);
+        if (two_targets)
+            slot.targets[1] = m_gpu.pool().acquire_target(width, height);
+        if (!slot.input.texture || !slot.targets[0].fbo || (two_targets && !slot.targets[1].fbo))
+        {
+            release(slot);
+            return NULL;
+        }
+    }
+    return &slot;
+}
+
+void FramePipeline::queue(Slot& slot, int width, int height)
+{
+    // Queue the chain, its readback when pixel pack buffers are available, & hand the commands
+    // to the GPU without waiting for them
+    int index = (int)(m_submitted % m_slots.size());
+    slot.result = m_gpu.render(slot.input.texture, slot.targets, width, height);
+    slot.queued = m_readback.start(index, slot.targets[slot.result]);
+    glFlush();
+    ++m_submitted;
+}
+
+bool FramePipeline::submit(const unsigned char* src, int width, int height)
+{
+    //1. Resources of the next slot
+    Slot* slot = prepare(width, height, false);
+    if (!slot)
+        return false;
+
+    //2. Upload into this slot texture, no frame still in flight reads it
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, slot->input.texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, src);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    //3. Filter it
+    queue(*slot, width, height);
+    return true;
+}
+
+bool FramePipeline::submit_yuv(const unsigned char* src, int width, int height, YuvFormat format)
+{
+    Slot* slot = prepare(width, height, true);
+    if (!slot || !m_gpu.convert_yuv(src, width, height, format, slot->input))
+        return false;
+    queue(*slot, width, height);
+    return true;
+}
+
+bool FramePipeline::receive(unsigned char* dst, int &width, int &height)
+{
+    if (m_received == m_submitted)
+        return false;
+
+    int index = (int)(m_received % m_slots.size());
+    Slot& slot = m_slots[index];
+    width = slot.input.width;
+    height = slot.input.height;
+    ++m_received;
+    if (slot.queued)
+    {
+        slot.queued = false;
+        return m_readback.finish(index, dst);
+    }
+    m_gpu.read(slot.targets[slot.result], dst);
+    return true;
+}
+
+bool FramePipeline::ready()
+{
+    if (m_received == m_submitted)
+        return false;
+    int index = (int)(m_received % m_slots.size());
+    // Without readback buffers only a blocking glReadPixels can tell
+    return !m_slots[index].queued || m_readback.poll(index);
+}
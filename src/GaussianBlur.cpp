@@ -0,0 +1,75 @@
+#include "GaussianBlur.hpp"
+
+#include <cmath>
+#include <iostream>
+
+int gaussian_default_radius(float sigma)
+{
+    int radius = (int)std::ceil(3.f * sigma);
+    return radius < 1 ? 1 : radius;
+}
+
+void gaussian_linear_taps(float sigma, int radius, std::vector<float> &offsets, std::vector<float> &weights)
+{
+    // Discrete kernel, only the positive half is stored since it is symmetric
+    std::vector<float> kernel(radius + 2, 0.f);
+    float sum = 0.f;
+    for (int i = 0 ; i <= radius ; ++i)
+    {
+        kernel[i] = std::exp(-(i * i) / (2.f * sigma * sigma));
+        sum += (i == 0) ? kernel[i] : 2.f * kernel[i];
+    }
+    for (int i = 0 ; i <= radius ; ++i)
+        kernel[i] /= sum;
+
+    offsets.clear();
+    weights.clear();
+    offsets.push_back(0.f);
+    weights.push_back(kernel[0]);
+
+    // Taps i & i+1 are replaced by one fetch placed so that bilinear filtering gives each one its own weight.
+    // When radius is odd the last tap is paired with a zero weight and ends up exactly on texel 'radius'.
+    for (int i = 1 ; i <= radius ; i += 2)
+    {
+        float weight = kernel[i] + kernel[i + 1];
+        // Far taps of a tiny sigma underflow to 0, the fetch then stays on texel i instead of 0 / 0
+        offsets.push_back(weight > 0.f ? (i * kernel[i] + (i + 1) * kernel[i + 1]) / weight : (float)i);
+        weights.push_back(weight);
+    }
+}
+
+bool add_gaussian_blur(GpuFilterContext& gpu, const std::string& vertex_shader_path,
+                       const std::string& fragment_shader_path, float sigma, int radius)
+{
+    if (sigma <= 0.f) {
+        std::cerr << "Gaussian sigma must be > 0 (got " << sigma << ")." << std::endl;
+        return false;
+    }
+    if (radius <= 0)
+        radius = gaussian_default_radius(sigma);
+    if (radius > 2 * (GAUSSIAN_MAX_TAPS - 1)) {
+        std::cerr << "Warning: gaussian radius " << radius << " clamped to " << 2 * (GAUSSIAN_MAX_TAPS - 1) << "." << std::endl;
+        radius = 2 * (GAUSSIAN_MAX_TAPS - 1);
+    }
+
+    std::vector<float> offsets, weights;
+    gaussian_linear_taps(sigma, radius, offsets, weights);
+
+    // Horizontal then vertical pass. Uniforms are program state so they only need to be set once.
+    for (int direction = 0 ; direction < 2 ; ++direction)
+    {
+        FilterPass* pass = gpu.add_pass(vertex_shader_path, fragment_shader_path);
+        if (!pass)
+            return false;
+        pass->linear = true;
+        pass->radius = radius;
+
+        glUseProgram(pass->program);
+        glUniform2f(glGetUniformLocation(pass->program, "direction"), direction == 0 ? 1.f : 0.f, direction == 0 ? 0.f : 1.f);
+        glUniform1i(glGetUniformLocation(pass->program, "taps"), (GLint)offsets.size());
+        glUniform1fv(glGetUniformLocation(pass->program, "offsets"), (GLsizei)offsets.size(), &offsets[0]);
+        glUniform1fv(glGetUniformLocation(pass->program, "weights"), (GLsizei)weights.size(), &weights[0]);
+    }
+    glUseProgram(0);
+    return true;
+}
@@ -0,0 +1,147 @@
+#include "GaussianPyramid.hpp"
+
+#include <iostream>
+
+GaussianPyramid::GaussianPyramid(GpuFilterContext& gpu)
+    : m_gpu(gpu), m_program(0), m_texture_loc(-1), m_source_size_loc(-1), m_width(0), m_height(0)
+{
+}
+
+GaussianPyramid::~GaussianPyramid()
+{
+    release();
+    if (m_program)
+        glDeleteProgram(m_program);
+}
+
+bool GaussianPyramid::load_program(const std::string& vertex_shader_path, const std::string& fragment_shader_path)
+{
+    if (m_program)
+        glDeleteProgram(m_program);
+    m_program = m_gpu.programs().load(vertex_shader_path, fragment_shader_path);
+    if (!m_program) {
+        std::cerr << "Failed to create the downsampling program. See above for more details" << std::endl;
+        return false;
+    }
+    m_texture_loc = glGetUniformLocation(m_program, "texture");
+    m_source_size_loc = glGetUniformLocation(m_program, "source_size");
+    return true;
+}
+
+int GaussianPyramid::level_width(int level) const
+{
+    return level == 0 ? m_width : m_levels[level - 1].width;
+}
+
+int GaussianPyramid::level_height(int level) const
+{
+    return level == 0 ? m_height : m_levels[level - 1].height;
+}
+
+void GaussianPyramid::release()
+{
+    for (size_t i = 0 ; i < m_levels.size() ; ++i)
+        m_gpu.pool().release(m_levels[i]);
+    for (size_t i = 0 ; i < m_scratch.size() ; ++i)
+        m_gpu.pool().release(m_scratch[i]);
+    m_levels.clear();
+    m_scratch.clear();
+    m_width = m_height = 0;
+}
+
+bool GaussianPyramid::build(const unsigned char* src, int width, int height, int levels, PixelLayout layout)
+{
+    if (!m_program || m_gpu.pass_count() == 0) {
+        std::cerr << "The pyramid needs a downsampling program & a blur loaded in the context." << std::endl;
+        return false;
+    }
+    if (width > m_gpu.tile_size() || height > m_gpu.tile_size()) {
+        std::cerr << "Pyramids are not tiled, " << width << "x" << height << " exceeds the tile size " << m_gpu.tile_size() << "." << std::endl;
+        return false;
+    }
+
+    //1. Level sizes, halved & rounded up until 1x1
+    std::vector<int> widths(1, width), heights(1, height);
+    while ((int)widths.size() < levels && (widths.back() > 1 || heights.back() > 1))
+    {
+        widths.push_back((widths.back() + 1) / 2);
+        heights.push_back((heights.back() + 1) / 2);
+    }
+
+    //2. Targets of every level & the blur targets of the intermediate ones, all acquired before any draw:
+    // FBOs created by init_fbo, recycled by the pool. They are only exchanged when the size or format changes.
+    GLenum format = layout_formats(layout).target;
+    size_t count = widths.size() - 1;
+    if (width != m_width || height != m_height || m_levels.size() != count
+        || (count > 0 && m_levels[0].format != format) || m_scratch.size() != (count > 0 ? 2 * (count - 1) : 0))
+    {
+        release();
+        for (size_t i = 1 ; i <= count ; ++i)
+        {
+            m_levels.push_back(m_gpu.pool().acquire_target(widths[i], heights[i], format));
+            if (!m_levels.back().fbo)
+                return false;
+            // The last level is never blurred
+            for (int t = 0 ; i < count && t < 2 ; ++t)
+            {
+                m_scratch.push_back(m_gpu.pool().acquire_target(widths[i], heights[i], format));
+                if (!m_scratch.back().fbo)
+                    return false;
+            }
+        }
+        m_width = width;
+        m_height = height;
+    }
+
+    //3. One upload, the chain blurs level 0 in the context targets
+    if (!m_gpu.upload(src, width, height, GL_UNSIGNED_BYTE, layout))
+        return false;
+    m_gpu.draw();
+    GLuint blurred = m_gpu.result().texture;
+
+    //4. Downsample the blurred level into the next one, then blur that one in its own targets
+    glActiveTexture(GL_TEXTURE0);
+    for (size_t i = 0 ; i < count ; ++i)
+    {
+        const RenderTarget& next = m_levels[i];
+        glBindFramebuffer(GL_FRAMEBUFFER, next.fbo);
+        glViewport(0, 0, next.width, next.height);
+        glUseProgram(m_program);
+        glBindTexture(GL_TEXTURE_2D, blurred);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glUniform1i(m_texture_loc, 0);
+        glUniform2f(m_source_size_loc, (float)widths[i], (float)heights[i]);
+        m_gpu.draw_quad(m_program);
+
+        if (i + 1 < count)
+        {
+            const RenderTarget* targets = &m_scratch[2 * i];
+            blurred = targets[m_gpu.render(next.texture, targets, next.width, next.height)].texture;
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return true;
+}
+
+bool GaussianPyramid::read(int level, unsigned char* dst, PixelLayout layout)
+{
+    if (level < 1 || level >= levels()) {
+        std::cerr << "No level " << level << " in a pyramid of " << levels() << " levels." << std::endl;
+        return false;
+    }
+    m_gpu.read(m_levels[level - 1], dst, GL_UNSIGNED_BYTE, layout);
+    return true;
+}
+
+bool GaussianPyramid::process(const unsigned char* src, int width, int height, const std::vector<unsigned char*>& dst,
+                              PixelLayout layout)
+{
+    if (!build(src, width, height, (int)dst.size(), layout))
+        return false;
+    for (int level = 1 ; level < levels() ; ++level)
+        if (dst[level] && !read(level, dst[level], layout))
+            return false;
+    return true;
+}
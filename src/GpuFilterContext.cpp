@@ -0,0 +1,617 @@
+#include "GpuFilterContext.hpp"
+#include "gles_utils.hpp"
+#include "cpu_filters.hpp"
+#include "TileScheduler.hpp"
+#include "pixel_conversions.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+namespace
+{
+// eglInitialize/eglTerminate are not reference counted and every context of the process gets the
+// same default display: it is only terminated once the last context using it is released.
+std::mutex display_mutex;
+int display_users = 0;
+}
+
+GpuFilterContext::GpuFilterContext()
+    : m_display(EGL_NO_DISPLAY), m_surface(EGL_NO_SURFACE), m_context(EGL_NO_CONTEXT),
+      m_last_target(0), m_width(0), m_height(0), m_max_tile_size(0), m_tile_size(0),
+      m_yuv_program(0), m_quad(NULL)
+{
+    const RenderTarget none = { 0, 0, 0, 0, GL_RGB, GL_UNSIGNED_BYTE };
+    m_input = m_target[0] = m_target[1] = none;
+    m_planes[0] = m_planes[1] = m_planes[2] = none;
+    for (int i = 0 ; i <= PIXELS_GRAY ; ++i)
+        m_formats_known[i] = false;
+}
+
+GpuFilterContext::~GpuFilterContext()
+{
+    release();
+}
+
+bool GpuFilterContext::init()
+{
+    //1. Get a EGL valid display
+    m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (m_display == EGL_NO_DISPLAY) {
+        std::cerr << "Failed to get EGL Display" << std::endl
+            << "Error: " << eglGetError() << std::endl;
+        return false;
+    }
+
+    //2. Initialize EGL. Create a connection to the display.
+    int minor, major;
+    {
+        std::lock_guard<std::mutex> lock(display_mutex);
+        if (eglInitialize(m_display, &minor, &major) == EGL_FALSE) {
+            std::cerr << "Failed to initialize EGL Display" << std::endl
+                << "Error: " << eglGetError() << std::endl;
+            m_display = EGL_NO_DISPLAY;
+            return false;
+        }
+        ++display_users;
+    }
+    std::cerr << "Successfully intialized display (OpenGL ES version " << minor << "." << major << ")." << std::endl;
+
+    //3. Find a config that match specified requirements (in gles_utils.hpp).
+    EGLConfig config;
+    EGLint num_configs;
+    if (!eglChooseConfig(m_display, EGL_CONFIG_ATTRIBUTES, &config, 1, &num_configs)) {
+        std::cerr << "Failed to choose EGL Config" << std::endl
+            << "Error: " << eglGetError() << std::endl;
+        release();
+        return false;
+    }
+
+    //4. Creating an OpenGL Render Surface. Every draw goes to an FBO so the pbuffer itself can stay tiny.
+    EGLint pbufferAttributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+    m_surface = eglCreatePbufferSurface(m_display, config, pbufferAttributes);
+    if (m_surface == EGL_NO_SURFACE) {
+        std::cerr << "Failed to create EGL Surface." << std::endl
+            << "Error: " << eglGetError() << std::endl;
+        release();
+        return false;
+    }
+
+    //5. Make OpenGL ES the current API.
+    eglBindAPI(EGL_OPENGL_API);
+
+    //6. Create a context.
+    m_context = eglCreateContext(m_display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (m_context == EGL_NO_CONTEXT) {
+        std::cerr << "Failed to create EGL Context." << std::endl
+            << "Error: " << eglGetError() << std::endl;
+        release();
+        return false;
+    }
+
+    //7. Bind context to to the current thread.
+    if (!eglMakeCurrent(m_display, m_surface, m_surface, m_context)) {
+        std::cerr << "Failed to make the egl context to the current one." << std::endl;
+        release();
+        return false;
+    }
+
+    // Create fullscreen quad used to trigger rasterisation (use of vertex and fragment shaders)
+    m_quad = new Quad();
+    m_quad->init();
+
+    //8. Largest image renderable in one go, beyond that process() works by tiles
+    GLint max_texture_size = 0, max_viewport[2] = {0, 0};
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, max_viewport);
+    m_max_tile_size = std::min(max_texture_size, (GLint)std::min(max_viewport[0], max_viewport[1]));
+    set_tile_size(getenv("IPOGLES_TILE_SIZE") ? atoi(getenv("IPOGLES_TILE_SIZE")) : 0);
+
+    return true;
+}
+
+bool GpuFilterContext::load_program(const std::string& vertex_shader_path, const std::string& fragment_shader_path)
+{
+    clear_passes();
+    return add_pass(vertex_shader_path, fragment_shader_path) != NULL;
+}
+
+FilterPass* GpuFilterContext::add_pass(const std::string& vertex_shader_path, const std::string& fragment_shader_path)
+{
+    GLuint program = m_programs.load(vertex_shader_path, fragment_shader_path);
+    if (!program) {
+        std::cerr << "Failed to create shader program. See above for more details" << std::endl;
+        return NULL;
+    }
+
+    CpuFilter filter;
+    return append_pass(program, cpu_filter_from_shader(fragment_shader_path, filter) ? cpu_filter_radius(filter) : DEFAULT_PASS_RADIUS);
+}
+
+FilterPass* GpuFilterContext::add_pass_source(const std::string& vertex_shader_path, const std::string& fragment_source, int radius)
+{
+    std::string vertex_source;
+    if (!read_file(vertex_shader_path, vertex_source)) {
+        std::cerr << "Could not read " << vertex_shader_path << std::endl;
+        return NULL;
+    }
+    GLuint program = m_programs.load_source(vertex_source, fragment_source);
+    if (!program) {
+        std::cerr << "Failed to create shader program. See above for more details" << std::endl;
+        return NULL;
+    }
+    return append_pass(program, radius);
+}
+
+FilterPass* GpuFilterContext::append_pass(GLuint program, int radius)
+{
+    FilterPass pass;
+    pass.program = program;
+    // Getting location of our uniform variables
+    pass.texture_loc = glGetUniformLocation(program, "texture");
+    pass.width_loc = glGetUniformLocation(program, "width");
+    pass.height_loc = glGetUniformLocation(program, "height");
+    pass.linear = false;
+    pass.radius = radius;
+    pass.border_program = 0;
+    pass.border = 0;
+    m_passes.push_back(pass);
+    return &m_passes.back();
+}
+
+bool GpuFilterContext::set_border_program(FilterPass& pass, const std::string& vertex_shader_path,
+                                          const std::string& fragment_source, int border)
+{
+    std::string vertex_source;
+    if (!read_file(vertex_shader_path, vertex_source)) {
+        std::cerr << "Could not read " << vertex_shader_path << std::endl;
+        return false;
+    }
+    GLuint program = m_programs.load_source(vertex_source, fragment_source);
+    if (!program) {
+        std::cerr << "Failed to create the border program. See above for more details" << std::endl;
+        return false;
+    }
+    if (pass.border_program)
+        glDeleteProgram(pass.border_program);
+    pass.border_program = program;
+    pass.border_texture_loc = glGetUniformLocation(program, "texture");
+    pass.border_width_loc = glGetUniformLocation(program, "width");
+    pass.border_height_loc = glGetUniformLocation(program, "height");
+    pass.border = border;
+    return true;
+}
+
+void GpuFilterContext::clear_passes()
+{
+    for (size_t i = 0 ; i < m_passes.size() ; ++i)
+    {
+        glDeleteProgram(m_passes[i].program);
+        if (m_passes[i].border_program)
+            glDeleteProgram(m_passes[i].border_program);
+    }
+    m_passes.clear();
+}
+
+bool GpuFilterContext::resize(int width, int height, GLenum format)
+{
+    if (width == m_width && height == m_height && m_target[0].fbo && m_target[0].format == format)
+        return true;
+
+    // Hand the previous targets back to the pool, alternating sizes then reuse them instead of reallocating.
+    for (int i = 0 ; i < 2 ; ++i)
+    {
+        m_pool.release(m_target[i]);
+        m_target[i].fbo = m_target[i].texture = 0;
+    }
+    m_width = m_height = 0;
+
+    // Create a FBO that will allow us to do offscreen rendering
+    m_target[0] = m_pool.acquire_target(width, height, format);
+    if (!m_target[0].fbo)
+        return false;
+
+    m_width = width;
+    m_height = height;
+    return true;
+}
+
+bool GpuFilterContext::ensure_targets()
+{
+    if (m_passes.size() < 2 || m_target[1].fbo)
+        return true;
+    m_target[1] = m_pool.acquire_target(m_width, m_height, m_target[0].format);
+    return m_target[1].fbo != 0;
+}
+
+const LayoutFormats& GpuFilterContext::formats(PixelLayout layout)
+{
+    if (!m_formats_known[layout])
+    {
+        m_formats[layout] = layout_formats(layout);
+        m_formats_known[layout] = true;
+    }
+    return m_formats[layout];
+}
+
+bool GpuFilterContext::upload(const void* src, int width, int height, GLenum type, PixelLayout layout)
+{
+    const LayoutFormats& format = formats(layout);
+    if (!resize(width, height, format.target))
+        return false;
+
+    if (m_input.width != width || m_input.height != height || m_input.type != type
+        || m_input.format != format.texture || !m_input.texture)
+    {
+        m_pool.release(m_input);
+        m_input = m_pool.acquire_texture(width, height, format.texture, type);
+        if (!m_input.texture)
+            return false;
+    }
+
+    //1. Layouts the driver cannot take as they are are swizzled on the CPU, into the texture order
+    GLenum upload_format = format.upload;
+    int channels = layout_channels(layout);
+    if (upload_format == 0)
+    {
+        if (type != GL_UNSIGNED_BYTE) {
+            std::cerr << "This driver only uploads BGR(A) images of 8 bits." << std::endl;
+            return false;
+        }
+        m_staging.resize((size_t)width * height * channels);
+        convert_swap_red_blue((const unsigned char*)src, &m_staging[0], (size_t)width * height, channels);
+        src = &m_staging[0];
+        upload_format = format.texture;
+    }
+
+    //2. The storage already has the right size & type, only its content is replaced.
+    size_t row_size = (size_t)width * channels * (type == GL_UNSIGNED_BYTE ? 1 : (type == GL_FLOAT ? 4 : 2));
+    glPixelStorei(GL_UNPACK_ALIGNMENT, row_size % 4 == 0 ? 4 : 1);
+    glBindTexture(GL_TEXTURE_2D, m_input.texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, upload_format, type, src);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return true;
+}
+
+bool GpuFilterContext::load_yuv_program(const std::string& vertex_shader_path, const std::string& fragment_shader_path)
+{
+    if (m_yuv_program)
+        glDeleteProgram(m_yuv_program);
+    m_yuv_program = m_programs.load(vertex_shader_path, fragment_shader_path);
+    if (!m_yuv_program) {
+        std::cerr << "Failed to create the YUV conversion program. See above for more details" << std::endl;
+        return false;
+    }
+    const char* names[] = { "y_plane", "u_plane", "v_plane", "interleaved", "width", "height" };
+    for (int i = 0 ; i < 6 ; ++i)
+        m_yuv_locations[i] = glGetUniformLocation(m_yuv_program, names[i]);
+    return true;
+}
+
+bool GpuFilterContext::convert_yuv(const unsigned char* src, int width, int height, YuvFormat format, const RenderTarget& target)
+{
+    if (!m_yuv_program) {
+        std::cerr << "No YUV conversion program loaded." << std::endl;
+        return false;
+    }
+    if (width % 2 || height % 2) {
+        std::cerr << "YUV frames must have an even size (got " << width << "x" << height << ")." << std::endl;
+        return false;
+    }
+
+    //1. One texture per plane: Y & the chroma ones at half resolution, NV12 chroma as luminance & alpha.
+    // They are all acquired before binding any, the pool binds textures on the active unit.
+    int planes = format == YUV_I420 ? 3 : 2;
+    for (int i = 0 ; i < planes ; ++i)
+    {
+        int plane_width = i == 0 ? width : width / 2, plane_height = i == 0 ? height : height / 2;
+        GLenum plane_format = (i == 1 && format == YUV_NV12) ? GL_LUMINANCE_ALPHA : GL_LUMINANCE;
+        if (m_planes[i].width != plane_width || m_planes[i].height != plane_height
+            || m_planes[i].format != plane_format || !m_planes[i].texture)
+        {
+            m_pool.release(m_planes[i]);
+            m_planes[i] = m_pool.acquire_texture(plane_width, plane_height, plane_format);
+            if (!m_planes[i].texture)
+                return false;
+        }
+    }
+    const unsigned char* plane_data[3] = { src, src + (size_t)width * height, src + (size_t)width * height * 5 / 4 };
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int i = 0 ; i < planes ; ++i)
+    {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, m_planes[i].texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_planes[i].width, m_planes[i].height, m_planes[i].format,
+                        GL_UNSIGNED_BYTE, plane_data[i]);
+    }
+
+    //2. Convert into the target, each output pixel samples its own luma & the chroma of its 2x2 block
+    glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+    glViewport(0, 0, width, height);
+    glUseProgram(m_yuv_program);
+    for (int i = 0 ; i < 3 ; ++i)
+        glUniform1i(m_yuv_locations[i], i < planes ? i : 1);
+    glUniform1i(m_yuv_locations[3], format == YUV_NV12 ? 1 : 0);
+    glUniform1i(m_yuv_locations[4], width);
+    glUniform1i(m_yuv_locations[5], height);
+    m_quad->display(m_yuv_program);
+
+    for (int i = planes - 1 ; i >= 0 ; --i)
+    {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return true;
+}
+
+bool GpuFilterContext::upload_yuv(const unsigned char* src, int width, int height, YuvFormat format)
+{
+    if (!resize(width, height, GL_RGB))
+        return false;
+
+    // The input becomes a render target, the conversion draws into it
+    if (m_input.width != width || m_input.height != height || m_input.type != GL_UNSIGNED_BYTE
+        || m_input.format != GL_RGB || !m_input.fbo)
+    {
+        m_pool.release(m_input);
+        m_input = m_pool.acquire_target(width, height);
+        if (!m_input.fbo)
+            return false;
+    }
+    return convert_yuv(src, width, height, format, m_input);
+}
+
+void GpuFilterContext::draw()
+{
+    if (!ensure_targets())
+        return;
+    m_last_target = render(m_input.texture, m_target, m_width, m_height);
+}
+
+int GpuFilterContext::render(GLuint source, const RenderTarget* targets, int width, int height)
+{
+    glViewport(0, 0, width, height);
+    glActiveTexture(GL_TEXTURE0);
+
+    // The first pass samples the source texture, every following one samples the render texture of the previous pass.
+    int target = 0;
+    for (size_t i = 0 ; i < m_passes.size() ; ++i)
+    {
+        const FilterPass& pass = m_passes[i];
+        target = i % 2;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, targets[target].fbo);
+        glClearColor(0.0, 0.0, 0.0, 1.0);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        GLint filter = pass.linear ? GL_LINEAR : GL_NEAREST;
+        glBindTexture(GL_TEXTURE_2D, source);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+
+        glUseProgram(pass.program);
+        glUniform1i(pass.texture_loc, 0);
+        glUniform1i(pass.width_loc, width);
+        glUniform1i(pass.height_loc, height);
+
+        if (!pass.border_program)
+            m_quad->display(pass.program);
+        else
+        {
+            // The main program inside, the border one on the four strips around it
+            int border = std::min(pass.border, std::min(width, height) / 2);
+            glEnable(GL_SCISSOR_TEST);
+            glScissor(border, border, width - 2 * border, height - 2 * border);
+            m_quad->display(pass.program);
+
+            glUseProgram(pass.border_program);
+            glUniform1i(pass.border_texture_loc, 0);
+            glUniform1i(pass.border_width_loc, width);
+            glUniform1i(pass.border_height_loc, height);
+            const GLint strips[4][4] = { { 0, 0, width, border }, { 0, height - border, width, border },
+                                         { 0, border, border, height - 2 * border }, { width - border, border, border, height - 2 * border } };
+            for (int s = 0 ; s < 4 ; ++s)
+            {
+                glScissor(strips[s][0], strips[s][1], strips[s][2], strips[s][3]);
+                m_quad->display(pass.border_program);
+            }
+            glDisable(GL_SCISSOR_TEST);
+        }
+
+        source = targets[target].texture;
+    }
+    return target;
+}
+
+void GpuFilterContext::read(void* dst, GLenum type, PixelLayout layout)
+{
+    read(m_target[m_last_target], dst, type, layout);
+}
+
+void GpuFilterContext::read(const RenderTarget& target, void* dst, GLenum type, PixelLayout layout)
+{
+    // Layouts the driver cannot read as they are go through the target format & a CPU conversion
+    GLenum read_format = formats(layout).read;
+    int channels = layout_channels(layout), read_channels = channels;
+    size_t pixels = (size_t)target.width * target.height;
+    void* read_dst = dst;
+    if (read_format == 0 && type == GL_UNSIGNED_BYTE)
+    {
+        read_format = target.format;
+        read_channels = target.format == GL_RGBA ? 4 : 3;
+        m_staging.resize(pixels * read_channels);
+        read_dst = &m_staging[0];
+    }
+    else if (read_format == 0)
+    {
+        std::cerr << "This driver only reads BGR(A) & single channel images of 8 bits." << std::endl;
+        return;
+    }
+
+    // Once rasterisation is done, data have been generated and it is now possible to transfer them back from VRAM to memory.
+    size_t row_size = (size_t)target.width * read_channels * (type == GL_UNSIGNED_BYTE ? 1 : (type == GL_FLOAT ? 4 : 2));
+    glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, row_size % 4 == 0 ? 4 : 1);
+    glReadPixels(0, 0, target.width, target.height, read_format, type, read_dst);
+
+    if (read_dst != dst)
+    {
+        // Same as the GL_RED read: the red channel, whatever the filters left in the others
+        if (layout == PIXELS_GRAY)
+            convert_red_to_gray(&m_staging[0], (unsigned char*)dst, pixels, read_channels);
+        else
+            convert_swap_red_blue(&m_staging[0], (unsigned char*)dst, pixels, channels);
+    }
+
+    // Switching back to our classic buffer
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+bool GpuFilterContext::process(const unsigned char* src, unsigned char* dst, int width, int height, PixelLayout layout)
+{
+    if (m_passes.empty()) {
+        std::cerr << "No shader program loaded." << std::endl;
+        return false;
+    }
+    size_t row_size = (size_t)width * layout_channels(layout);
+    if (width > m_tile_size || height > m_tile_size)
+    {
+        return process_tiled(width, height,
+            [&](int y, int rows, unsigned char* rows_dst) {
+                memcpy(rows_dst, src + y * row_size, rows * row_size);
+                return true;
+            },
+            [&](int y, int rows, const unsigned char* rows_src) {
+                memcpy(dst + y * row_size, rows_src, rows * row_size);
+                return true;
+            }, layout);
+    }
+    if (!upload(src, width, height, GL_UNSIGNED_BYTE, layout))
+        return false;
+    draw();
+    read(dst, GL_UNSIGNED_BYTE, layout);
+    return true;
+}
+
+bool GpuFilterContext::process_tiled(int width, int height, const RowReader& read_rows, const RowWriter& write_rows,
+                                     PixelLayout layout)
+{
+    if (m_passes.empty()) {
+        std::cerr << "No shader program loaded." << std::endl;
+        return false;
+    }
+    int halo = this->halo();
+    int inner = m_tile_size - 2 * halo;
+    if (inner < 1) {
+        std::cerr << "Tile size " << m_tile_size << " is too small for a halo of " << halo << " pixels." << std::endl;
+        return false;
+    }
+
+    // Tiles come row by row, all the tiles of a row share the same band of source rows.
+    std::vector<Tile> tiles = make_tiles(width, height, inner, inner, halo);
+    std::vector<unsigned char> band_in, band_out, tile_in, tile_out;
+    int channels = layout_channels(layout);
+    size_t row_size = (size_t)width * channels;
+    for (size_t first = 0 ; first < tiles.size() ; )
+    {
+        const Tile& row = tiles[first];
+        size_t last = first;
+        while (last < tiles.size() && tiles[last].y == row.y)
+            ++last;
+
+        //1. Stream in the rows of the band, halo included
+        band_in.resize(row_size * row.halo_height);
+        if (!read_rows(row.halo_y, row.halo_height, &band_in[0]))
+            return false;
+        band_out.resize(row_size * row.height);
+
+        for (size_t i = first ; i < last ; ++i)
+        {
+            const Tile& tile = tiles[i];
+
+            //2. Gather the tile with its halo, full width tiles are used in place
+            const unsigned char* tile_src = &band_in[0];
+            size_t tile_row_size = (size_t)tile.halo_width * channels;
+            if (tile.halo_width != width)
+            {
+                tile_in.resize(tile_row_size * tile.halo_height);
+                for (int y = 0 ; y < tile.halo_height ; ++y)
+                    memcpy(&tile_in[y * tile_row_size], &band_in[y * row_size + tile.halo_x * channels], tile_row_size);
+                tile_src = &tile_in[0];
+            }
+
+            //3. Filter it
+            if (!upload(tile_src, tile.halo_width, tile.halo_height, GL_UNSIGNED_BYTE, layout))
+                return false;
+            draw();
+            tile_out.resize(tile_row_size * tile.halo_height);
+            read(&tile_out[0], GL_UNSIGNED_BYTE, layout);
+
+            //4. Keep the inner part, the halo pixels saw a truncated neighbourhood
+            int offset_x = tile.x - tile.halo_x, offset_y = tile.y - tile.halo_y;
+            for (int y = 0 ; y < tile.height ; ++y)
+                memcpy(&band_out[y * row_size + tile.x * channels],
+                       &tile_out[(y + offset_y) * tile_row_size + offset_x * channels], (size_t)tile.width * channels);
+        }
+
+        //5. Stream out the finished band
+        if (!write_rows(row.y, row.height, &band_out[0]))
+            return false;
+        first = last;
+    }
+    return true;
+}
+
+void GpuFilterContext::set_tile_size(int size)
+{
+    m_tile_size = (size > 0 && size < m_max_tile_size) ? size : m_max_tile_size;
+}
+
+int GpuFilterContext::halo() const
+{
+    int halo = 0;
+    for (size_t i = 0 ; i < m_passes.size() ; ++i)
+        halo += m_passes[i].radius;
+    return halo;
+}
+
+void GpuFilterContext::release()
+{
+    if (m_context != EGL_NO_CONTEXT) {
+        delete m_quad;
+        m_quad = NULL;
+        m_pool.release(m_input);
+        m_pool.release(m_target[0]);
+        m_pool.release(m_target[1]);
+        for (int i = 0 ; i < 3 ; ++i)
+            m_pool.release(m_planes[i]);
+        m_pool.clear();
+        clear_passes();
+        if (m_yuv_program)
+            glDeleteProgram(m_yuv_program);
+        m_yuv_program = 0;
+        m_programs.clear();
+        eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(m_display, m_context);
+    }
+    m_passes.clear();
+    m_input.texture = m_input.fbo = m_target[0].fbo = m_target[0].texture = m_target[1].fbo = m_target[1].texture = 0;
+    m_planes[0].texture = m_planes[1].texture = m_planes[2].texture = 0;
+    m_width = m_height = 0;
+    m_context = EGL_NO_CONTEXT;
+
+    if (m_surface != EGL_NO_SURFACE)
+        eglDestroySurface(m_display, m_surface);
+    m_surface = EGL_NO_SURFACE;
+
+    if (m_display != EGL_NO_DISPLAY)
+    {
+        std::lock_guard<std::mutex> lock(display_mutex);
+        if (--display_users == 0)
+            eglTerminate(m_display);
+    }
+    m_display = EGL_NO_DISPLAY;
+}
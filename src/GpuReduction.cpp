@@ -0,0 +1,192 @@
+#include "GpuReduction.hpp"
+
+#include <iostream>
+
+GpuReduction::GpuReduction(GpuFilterContext& gpu)
+    : m_gpu(gpu), m_reduce_program(0), m_texture_loc(-1), m_source_size_loc(-1), m_image_size_loc(-1),
+      m_block_loc(-1), m_operation_loc(-1), m_histogram_program(0), m_width(0), m_height(0)
+{
+    RenderTarget none = { 0, 0, 0, 0, 0, 0 };
+    m_bins = none;
+    for (int i = 0 ; i < 4 ; ++i)
+        m_histogram_locations[i] = -1;
+}
+
+GpuReduction::~GpuReduction()
+{
+    release();
+    if (m_reduce_program)
+        glDeleteProgram(m_reduce_program);
+    if (m_histogram_program)
+        glDeleteProgram(m_histogram_program);
+}
+
+bool GpuReduction::load_reduce_program(const std::string& vertex_shader_path, const std::string& fragment_shader_path)
+{
+    if (m_reduce_program)
+        glDeleteProgram(m_reduce_program);
+    m_reduce_program = m_gpu.programs().load(vertex_shader_path, fragment_shader_path);
+    if (!m_reduce_program) {
+        std::cerr << "Failed to create the reduction program. See above for more details" << std::endl;
+        return false;
+    }
+    m_texture_loc = glGetUniformLocation(m_reduce_program, "texture");
+    m_source_size_loc = glGetUniformLocation(m_reduce_program, "source_size");
+    m_image_size_loc = glGetUniformLocation(m_reduce_program, "image_size");
+    m_block_loc = glGetUniformLocation(m_reduce_program, "block");
+    m_operation_loc = glGetUniformLocation(m_reduce_program, "operation");
+    return true;
+}
+
+bool GpuReduction::load_histogram_program(const std::string& vertex_shader_path, const std::string& fragment_shader_path)
+{
+    // Counts are summed by blending into a float target, 8 bits ones would saturate at 255
+    if (!float_targets_supported(true)) {
+        std::cerr << "The histogram needs float render targets with blending, not supported by this context." << std::endl;
+        return false;
+    }
+    if (m_histogram_program)
+        glDeleteProgram(m_histogram_program);
+    m_histogram_program = m_gpu.programs().load(vertex_shader_path, fragment_shader_path);
+    if (!m_histogram_program) {
+        std::cerr << "Failed to create the histogram program. See above for more details" << std::endl;
+        return false;
+    }
+    const char* names[4] = { "texture", "width", "height", "step" };
+    for (int i = 0 ; i < 4 ; ++i)
+        m_histogram_locations[i] = glGetUniformLocation(m_histogram_program, names[i]);
+    return true;
+}
+
+void GpuReduction::release()
+{
+    for (size_t i = 0 ; i < m_levels.size() ; ++i)
+        m_gpu.pool().release(m_levels[i]);
+    m_levels.clear();
+    m_gpu.pool().release(m_bins);
+    m_bins.fbo = m_bins.texture = 0;
+    m_width = m_height = 0;
+}
+
+bool GpuReduction::reduce(const RenderTarget& source, ReductionOp op, float result[3])
+{
+    if (!m_reduce_program) {
+        std::cerr << "The reduction program is not loaded." << std::endl;
+        return false;
+    }
+
+    //1. Targets of every level, a quarter of the previous one (rounded up) down to 1x1.
+    // They are only exchanged when the size changes.
+    if (source.width != m_width || source.height != m_height || m_levels.empty())
+    {
+        for (size_t i = 0 ; i < m_levels.size() ; ++i)
+            m_gpu.pool().release(m_levels[i]);
+        m_levels.clear();
+        bool exact = float_targets_supported(false);
+        int width = source.width, height = source.height;
+        do
+        {
+            width = (width + 3) / 4;
+            height = (height + 3) / 4;
+            m_levels.push_back(m_gpu.pool().acquire_target(width, height, exact ? GL_RGBA32F_EXT : GL_RGB,
+                                                           exact ? GL_FLOAT : GL_UNSIGNED_BYTE));
+            if (!m_levels.back().fbo)
+                return false;
+        } while (width > 1 || height > 1);
+        m_width = source.width;
+        m_height = source.height;
+    }
+
+    //2. Each level reduces the previous one, its texels standing for 4 times more pixels of the image
+    glActiveTexture(GL_TEXTURE0);
+    glUseProgram(m_reduce_program);
+    glUniform1i(m_texture_loc, 0);
+    glUniform2f(m_image_size_loc, (float)source.width, (float)source.height);
+    glUniform1i(m_operation_loc, (int)op);
+    GLuint texture = source.texture;
+    int width = source.width, height = source.height;
+    float block = 1.f;
+    for (size_t i = 0 ; i < m_levels.size() ; ++i)
+    {
+        const RenderTarget& next = m_levels[i];
+        glBindFramebuffer(GL_FRAMEBUFFER, next.fbo);
+        glViewport(0, 0, next.width, next.height);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glUniform2f(m_source_size_loc, (float)width, (float)height);
+        glUniform1f(m_block_loc, block);
+        m_gpu.draw_quad(m_reduce_program);
+
+        texture = next.texture;
+        width = next.width;
+        height = next.height;
+        block *= 4.f;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    //3. A single pixel is read back
+    const RenderTarget& last = m_levels.back();
+    glBindFramebuffer(GL_FRAMEBUFFER, last.fbo);
+    if (last.type == GL_FLOAT)
+    {
+        float pixel[4];
+        glReadPixels(0, 0, 1, 1, GL_RGBA, GL_FLOAT, pixel);
+        for (int c = 0 ; c < 3 ; ++c)
+            result[c] = pixel[c] * 255.f;
+    }
+    else
+    {
+        unsigned char pixel[4];
+        glReadPixels(0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+        for (int c = 0 ; c < 3 ; ++c)
+            result[c] = pixel[c];
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return true;
+}
+
+bool GpuReduction::histogram(const RenderTarget& source, unsigned int bins[HISTOGRAM_BINS], int step)
+{
+    if (!m_histogram_program) {
+        std::cerr << "The histogram program is not loaded." << std::endl;
+        return false;
+    }
+    if (step < 1)
+        step = 1;
+
+    //1. Counts are floats, exact up to 2^24 pixels per bin
+    if (!m_bins.fbo)
+    {
+        m_bins = m_gpu.pool().acquire_target(HISTOGRAM_BINS, 1, GL_RGBA32F_EXT, GL_FLOAT);
+        if (!m_bins.fbo)
+            return false;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, m_bins.fbo);
+    glViewport(0, 0, HISTOGRAM_BINS, 1);
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    //2. One point per sampled pixel, each one adds 1 to its bin
+    int columns = (source.width + step - 1) / step, rows = (source.height + step - 1) / step;
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, source.texture);
+    glUseProgram(m_histogram_program);
+    glUniform1i(m_histogram_locations[0], 0);
+    glUniform1i(m_histogram_locations[1], source.width);
+    glUniform1i(m_histogram_locations[2], source.height);
+    glUniform1i(m_histogram_locations[3], step);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glDrawArrays(GL_POINTS, 0, columns * rows);
+    glDisable(GL_BLEND);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    //3. 256 values are read back instead of the frame
+    float counts[HISTOGRAM_BINS * 4];
+    glReadPixels(0, 0, HISTOGRAM_BINS, 1, GL_RGBA, GL_FLOAT, counts);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    for (int i = 0 ; i < HISTOGRAM_BINS ; ++i)
+        bins[i] = (unsigned int)(counts[4 * i] + 0.5f);
+    return true;
+}
@@ -0,0 +1,145 @@
+#include "GpuWorkerPool.hpp"
+
+#include <chrono>
+#include <iostream>
+
+namespace
+{
+/**
+    Wait a bit longer after each failed attempt: spin first (frames are short), then sleep so that
+    idle workers do not take cores away from the rasterizer (llvmpipe renders on the CPU).
+*/
+void backoff(unsigned &attempt)
+{
+    if (attempt < 64)
+        std::this_thread::yield();
+    else
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    ++attempt;
+}
+}
+
+GpuWorkerPool::GpuWorkerPool()
+    : m_queue(NULL), m_stop(false), m_submitted(0), m_consumed(0)
+{
+}
+
+GpuWorkerPool::~GpuWorkerPool()
+{
+    stop();
+}
+
+bool GpuWorkerPool::start(unsigned workers, const Setup& setup, size_t queue_capacity)
+{
+    if (m_queue) {
+        std::cerr << "The GPU worker pool is already running, stop() it first." << std::endl;
+        return false;
+    }
+    if (workers == 0)
+        workers = 1;
+    m_stop = false;
+    m_submitted = m_consumed = 0;
+    m_queue = new BoundedQueue<GpuFrame>(queue_capacity);
+    // Every queued frame plus one per worker can be in flight at once
+    m_slots = std::vector<Slot>(m_queue->capacity() + workers);
+    for (size_t i = 0 ; i < m_slots.size() ; ++i)
+        m_slots[i].state = SLOT_FREE;
+
+    // One worker at a time: the first one compiles the programs, the others load their binaries.
+    for (unsigned i = 0 ; i < workers ; ++i)
+    {
+        std::atomic<int> ready(0);
+        m_threads.push_back(std::thread(&GpuWorkerPool::worker_loop, this, setup, &ready));
+        unsigned attempt = 0;
+        while (ready == 0)
+            backoff(attempt);
+        if (ready < 0) {
+            std::cerr << "Failed to set up GPU worker " << i << "." << std::endl;
+            stop();
+            return false;
+        }
+    }
+    return true;
+}
+
+void GpuWorkerPool::worker_loop(const Setup& setup, std::atomic<int>* ready)
+{
+    GpuFilterContext gpu;
+    bool ok = gpu.init() && setup(gpu);
+    // ready lives on the stack of start(), it must not be touched once signaled
+    ready->store(ok ? 1 : -1);
+    if (!ok)
+        return;
+
+    GpuFrame frame;
+    unsigned attempt = 0;
+    while (true)
+    {
+        if (!m_queue->pop(frame))
+        {
+            // Frames submitted before stop() are visible once m_stop is, look one last time
+            if (!m_stop) {
+                backoff(attempt);
+                continue;
+            }
+            if (!m_queue->pop(frame))
+                return;
+        }
+        attempt = 0;
+
+        frame.ok = gpu.process(frame.src, frame.dst, frame.width, frame.height);
+        Slot& slot = m_slots[frame.sequence % m_slots.size()];
+        slot.frame = frame;
+        slot.state.store(SLOT_DONE, std::memory_order_release);
+    }
+}
+
+unsigned long long GpuWorkerPool::submit(const unsigned char* src, unsigned char* dst, int width, int height)
+{
+    GpuFrame frame;
+    frame.sequence = m_submitted;
+    frame.src = src;
+    frame.dst = dst;
+    frame.width = width;
+    frame.height = height;
+    frame.ok = false;
+
+    //1. Wait for the slot of this sequence to be consumed by next()
+    Slot& slot = m_slots[frame.sequence % m_slots.size()];
+    unsigned attempt = 0;
+    while (slot.state.load(std::memory_order_acquire) != SLOT_FREE)
+        backoff(attempt);
+    slot.state.store(SLOT_PENDING, std::memory_order_relaxed);
+
+    //2. Then for room in the queue
+    attempt = 0;
+    while (!m_queue->push(frame))
+        backoff(attempt);
+    return m_submitted++;
+}
+
+bool GpuWorkerPool::next(GpuFrame &frame)
+{
+    if (m_consumed.load() == m_submitted.load())
+        return false;
+
+    Slot& slot = m_slots[m_consumed % m_slots.size()];
+    unsigned attempt = 0;
+    while (slot.state.load(std::memory_order_acquire) != SLOT_DONE)
+        backoff(attempt);
+    frame = slot.frame;
+    slot.state.store(SLOT_FREE, std::memory_order_release);
+    ++m_consumed;
+    return true;
+}
+
+void GpuWorkerPool::stop()
+{
+    // Workers drain the queue before leaving
+    m_stop = true;
+    for (size_t i = 0 ; i < m_threads.size() ; ++i)
+        m_threads[i].join();
+    m_threads.clear();
+    delete m_queue;
+    m_queue = NULL;
+}
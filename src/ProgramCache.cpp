@@ -0,0 +1,306 @@
+#include "ProgramCache.hpp"
+#include "gles_utils.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <functional>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Same values for GL_OES_get_program_binary, GL_ARB_get_program_binary & OpenGL ES 3
+#define PROGRAM_BINARY_LENGTH 0x8741
+#define NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#define PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+
+namespace
+{
+const char BINARY_MAGIC[4] = { 'I', 'P', 'G', 'B' };
+
+/**
+    64 bits FNV-1a hash, appended to the previous one when chaining strings.
+*/
+unsigned long long fnv1a(const std::string& data, unsigned long long hash = 14695981039346656037ULL)
+{
+    for (size_t i = 0 ; i < data.size() ; ++i)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+std::string to_hex(unsigned long long value)
+{
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016llx", value);
+    return buffer;
+}
+
+/**
+    Create a directory and its parents, like mkdir -p.
+*/
+bool make_directories(const std::string& path)
+{
+    for (size_t i = 1 ; i <= path.size() ; ++i)
+    {
+        if (i < path.size() && path[i] != '/')
+            continue;
+        std::string parent = path.substr(0, i);
+        if (mkdir(parent.c_str(), 0755) != 0 && errno != EEXIST)
+            return false;
+    }
+    return true;
+}
+
+std::string default_directory()
+{
+    const char* env = getenv("IPOGLES_SHADER_CACHE");
+    if (env)
+        return env;
+    env = getenv("XDG_CACHE_HOME");
+    if (env && *env)
+        return std::string(env) + "/ipogles";
+    env = getenv("HOME");
+    if (env && *env)
+        return std::string(env) + "/.cache/ipogles";
+    return "";
+}
+}
+
+ProgramCache::ProgramCache()
+    : m_directory(default_directory()), m_initialized(false),
+      m_get_program_binary(NULL), m_program_binary(NULL), m_program_parameter(NULL)
+{
+}
+
+ProgramCache::~ProgramCache()
+{
+    // Shader objects belong to the GL context, the owner calls clear() while it is still current.
+}
+
+void ProgramCache::init_binary_support()
+{
+    if (m_initialized)
+        return;
+    m_initialized = true;
+
+    const char* renderer = (const char*)glGetString(GL_RENDERER);
+    const char* version = (const char*)glGetString(GL_VERSION);
+    m_driver = std::string(renderer ? renderer : "") + "\n" + (version ? version : "");
+
+    //1. Find the entry points: the OES extension on OpenGL ES 2, core functions otherwise
+    bool es;
+    int major = gl_major_version(es);
+    if (has_gl_extension("GL_OES_get_program_binary"))
+    {
+        m_get_program_binary = (void (*)(GLuint, GLsizei, GLsizei*, GLenum*, void*))eglGetProcAddress("glGetProgramBinaryOES");
+        m_program_binary = (void (*)(GLuint, GLenum, const void*, GLint))eglGetProcAddress("glProgramBinaryOES");
+    }
+    else if ((es && major >= 3) || (!es && major >= 4) || has_gl_extension("GL_ARB_get_program_binary"))
+    {
+        m_get_program_binary = (void (*)(GLuint, GLsizei, GLsizei*, GLenum*, void*))eglGetProcAddress("glGetProgramBinary");
+        m_program_binary = (void (*)(GLuint, GLenum, const void*, GLint))eglGetProcAddress("glProgramBinary");
+        m_program_parameter = (void (*)(GLuint, GLenum, GLint))eglGetProcAddress("glProgramParameteri");
+    }
+
+    //2. A driver may expose the functions but no binary format at all
+    GLint formats = 0;
+    if (m_get_program_binary && m_program_binary)
+        glGetIntegerv(NUM_PROGRAM_BINARY_FORMATS, &formats);
+    glGetError(); // The query is an invalid enum on drivers without support
+    if (formats <= 0)
+    {
+        m_get_program_binary = NULL;
+        m_program_binary = NULL;
+        m_program_parameter = NULL;
+    }
+}
+
+bool ProgramCache::binaries_supported()
+{
+    init_binary_support();
+    return m_get_program_binary != NULL;
+}
+
+GLuint ProgramCache::load(const std::string& vertex_shader_path, const std::string& fragment_shader_path)
+{
+    std::string vertex_source, fragment_source;
+    if (!read_file(vertex_shader_path, vertex_source))
+    {
+        std::cerr << "Could not open vertex shader file: '" << vertex_shader_path << " '. Invalid file." << std::endl;
+        return 0;
+    }
+    if (!read_file(fragment_shader_path, fragment_source))
+    {
+        std::cerr << "Could not open fragment shader file: '" << fragment_shader_path << " '. Invalid file." << std::endl;
+        return 0;
+    }
+    return load_source(vertex_source, fragment_source);
+}
+
+GLuint ProgramCache::load_source(const std::string& vertex_source, const std::string& fragment_source)
+{
+    init_binary_support();
+
+    // The separator keeps ("ab", "c") & ("a", "bc") apart
+    std::string key = to_hex(fnv1a(m_driver + '\0' + vertex_source + '\0' + fragment_source));
+    std::string path = m_directory.empty() ? "" : m_directory + "/" + key + ".bin";
+
+    //1. Binary already loaded by this process, or saved by a previous one
+    if (m_get_program_binary)
+    {
+        std::map<std::string, Binary>::iterator it = m_binaries.find(key);
+        if (it == m_binaries.end() && !path.empty())
+        {
+            Binary binary;
+            if (read_binary(path, binary))
+                it = m_binaries.insert(std::make_pair(key, binary)).first;
+        }
+        if (it != m_binaries.end())
+        {
+            GLuint program = from_binary(it->second);
+            if (program)
+                return program;
+            // Stale (e.g. the driver changed without its version string), rebuild it from source
+            m_binaries.erase(it);
+        }
+    }
+
+    //2. Compile, reusing shader objects already compiled from the same source
+    GLuint vertex_shader = shader(GL_VERTEX_SHADER, vertex_source);
+    if (!vertex_shader) {
+        std::cerr << "Failed to compile vertex shader." << std::endl;
+        return 0;
+    }
+    GLuint fragment_shader = shader(GL_FRAGMENT_SHADER, fragment_source);
+    if (!fragment_shader) {
+        std::cerr << "Failed to compile fragment shader." << std::endl;
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    if (m_program_parameter)
+        m_program_parameter(program, PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glAttachShader(program, vertex_shader);
+    glAttachShader(program, fragment_shader);
+    glLinkProgram(program);
+    if (!check(program, GL_LINK_STATUS, glGetProgramiv, glGetProgramInfoLog, glDeleteProgram)) {
+        std::cerr << "Failed to link program." << std::endl;
+        return 0;
+    }
+    glDetachShader(program, vertex_shader);
+    glDetachShader(program, fragment_shader);
+
+    //3. Export the linked program for the next passes & processes
+    if (m_get_program_binary)
+    {
+        GLint length = 0;
+        glGetProgramiv(program, PROGRAM_BINARY_LENGTH, &length);
+        if (length > 0)
+        {
+            Binary binary;
+            binary.data.resize(length);
+            GLsizei written = 0;
+            m_get_program_binary(program, length, &written, &binary.format, &binary.data[0]);
+            if (glGetError() == GL_NO_ERROR && written > 0)
+            {
+                binary.data.resize(written);
+                m_binaries[key] = binary;
+                if (!path.empty())
+                    write_binary(path, binary);
+            }
+        }
+    }
+    return program;
+}
+
+GLuint ProgramCache::shader(GLenum type, const std::string& source)
+{
+    std::string key = to_hex(fnv1a(source, type));
+    std::map<std::string, GLuint>::iterator it = m_shaders.find(key);
+    if (it != m_shaders.end())
+        return it->second;
+
+    GLuint shader = compile_shader(type, source);
+    if (shader)
+        m_shaders[key] = shader;
+    return shader;
+}
+
+GLuint ProgramCache::from_binary(const Binary& binary)
+{
+    GLuint program = glCreateProgram();
+    m_program_binary(program, binary.format, &binary.data[0], (GLint)binary.data.size());
+    GLint success = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (glGetError() != GL_NO_ERROR || success == GL_FALSE)
+    {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+bool ProgramCache::read_binary(const std::string& path, Binary &binary)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+
+    // Layout: magic, format, size, then the driver blob
+    char magic[4];
+    unsigned int format = 0, size = 0;
+    bool valid = fread(magic, 1, 4, file) == 4 && memcmp(magic, BINARY_MAGIC, 4) == 0
+        && fread(&format, sizeof(format), 1, file) == 1
+        && fread(&size, sizeof(size), 1, file) == 1 && size > 0;
+    if (valid)
+    {
+        binary.format = format;
+        binary.data.resize(size);
+        valid = fread(&binary.data[0], 1, size, file) == size;
+    }
+    fclose(file);
+    return valid;
+}
+
+void ProgramCache::write_binary(const std::string& path, const Binary& binary)
+{
+    if (!make_directories(m_directory))
+    {
+        std::cerr << "Could not create shader cache directory '" << m_directory << "'." << std::endl;
+        return;
+    }
+
+    // Write to a private file then rename it, concurrent writers never see a partial binary.
+    // The worker threads of a process (GpuWorkerPool) each have their own cache, hence the thread in the name.
+    char suffix[64];
+    snprintf(suffix, sizeof(suffix), ".%d.%lx.tmp", (int)getpid(),
+             (unsigned long)std::hash<std::thread::id>()(std::this_thread::get_id()));
+    std::string tmp_path = path + suffix;
+    FILE* file = fopen(tmp_path.c_str(), "wb");
+    if (!file)
+        return;
+
+    unsigned int format = binary.format, size = (unsigned int)binary.data.size();
+    bool written = fwrite(BINARY_MAGIC, 1, 4, file) == 4
+        && fwrite(&format, sizeof(format), 1, file) == 1
+        && fwrite(&size, sizeof(size), 1, file) == 1
+        && fwrite(&binary.data[0], 1, size, file) == size;
+    written = fclose(file) == 0 && written;
+
+    if (!written || rename(tmp_path.c_str(), path.c_str()) != 0)
+        unlink(tmp_path.c_str());
+}
+
+void ProgramCache::clear()
+{
+    for (std::map<std::string, GLuint>::iterator it = m_shaders.begin() ; it != m_shaders.end() ; ++it)
+        glDeleteShader(it->second);
+    m_shaders.clear();
+    m_binaries.clear();
+    m_initialized = false;
+    m_get_program_binary = NULL;
+    m_program_binary = NULL;
+    m_program_parameter = NULL;
+}
@@ -1,10 +1,87 @@
 #include <RedisCameraServer.hpp>
 
+#include <chrono>
+#include <sstream>
+
+namespace
+{
+long long now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+}
+
 RedisCameraServer::RedisCameraServer()
+    : m_camera(NULL), m_metadata(NULL), m_ring(NULL), m_shmSlots(0), m_yuv(false), m_events(false), m_eventSequence(0),
+      m_capturing(false), m_latest(-1), m_reading(-1), m_sequence(0), m_published(0), m_publishedTime(0), m_dropped(0),
+      m_frameImage(NULL)
 {
     m_imageClient = new RedisImageHelper();
 }
 
+RedisCameraServer::~RedisCameraServer()
+{
+    stopCapture();
+    releaseCaptured();
+    delete m_frameImage;
+    delete m_ring;
+    delete m_metadata;
+}
+
+void RedisCameraServer::reuseImage(Image*& image, cv::Mat& buffer, int width, int height)
+{
+    // The Image owns its buffer (it frees it like the images getImage() returns), buffer only wraps it
+    if (image == NULL || image->width() != width || image->height() != height)
+    {
+        delete image;
+        image = new Image(width, height, 3, new unsigned char[(size_t)width * height * 3]);
+    }
+    buffer = cv::Mat(height, width, CV_8UC3, image->data());
+}
+
+void RedisCameraServer::releaseCaptured()
+{
+    for (size_t i = 0 ; i < m_captured.size() ; ++i)
+        delete m_captured[i].redisImage;
+    m_captured.clear();
+}
+
+bool RedisCameraServer::connectMetadata()
+{
+    if (m_metadata == NULL)
+        m_metadata = new RedisTransport();
+    return m_metadata->connected() || m_metadata->connect();
+}
+
+bool RedisCameraServer::enableSharedMemory(std::string name, int slots)
+{
+    if (!connectMetadata())
+        return false;
+    // The previous ring, if any, is unmapped & unlinked; the next frame creates the new one
+    delete m_ring;
+    m_ring = new ShmFrameRing();
+    m_shmName = name;
+    m_shmSlots = slots;
+    return true;
+}
+
+bool RedisCameraServer::enableFrameEvents()
+{
+    m_events = connectMetadata();
+    return m_events;
+}
+
+bool RedisCameraServer::enableYuvFrames()
+{
+    if (m_ring == NULL)
+    {
+        std::cout << "YUV frames need shared memory, see enableSharedMemory()" << std::endl;
+        return false;
+    }
+    m_yuv = true;
+    return true;
+}
+
 bool RedisCameraServer::start(std::string gstreamerCommand)
 {
     if (!m_imageClient->connect())
@@ -35,12 +112,175 @@ bool RedisCameraServer::start()
     return this->start("");
 }
 
-void RedisCameraServer::pickUpCameraFrame()
+bool RedisCameraServer::startCapture(int slots)
+{
+    if (m_camera == NULL || m_capturing)
+        return false;
+    releaseCaptured();
+    m_captured.assign(slots < 3 ? 3 : slots, CapturedFrame());
+    for (size_t i = 0 ; i < m_captured.size() ; ++i)
+    {
+        m_captured[i].redisImage = NULL;
+        m_captured[i].sequence = 0;
+    }
+    m_latest = m_reading = -1;
+    m_capturing = true;
+    m_captureThread = std::thread(&RedisCameraServer::captureLoop, this);
+    return true;
+}
+
+void RedisCameraServer::stopCapture()
+{
+    m_capturing = false;
+    if (m_captureThread.joinable())
+        m_captureThread.join();
+}
+
+void RedisCameraServer::captureLoop()
+{
+    cv::Mat frame;
+    while (m_capturing)
+    {
+        //1. Wait for the camera, only this thread ever does
+        if (!m_camera->read(frame) || frame.empty())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        long long timestamp = now_us();
+
+        //2. Take a slot that is neither the freshest frame nor the one being published
+        int slot = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_captureMutex);
+            while (slot == m_latest || slot == m_reading)
+                ++slot;
+        }
+
+        //3. Convert into it (YUV planes are kept as they are), the slot image keeps its allocation while the size does not change.
+        // RGB frames are converted straight into the buffer of the slot Redis image.
+        CapturedFrame& captured = m_captured[slot];
+        if (m_yuv)
+            frame.copyTo(captured.image);
+        else
+        {
+            reuseImage(captured.redisImage, captured.image, frame.cols, frame.rows);
+            cv::cvtColor(frame, captured.image, CV_BGR2RGB);
+        }
+
+        //4. It becomes the freshest frame, the previous one is dropped if nobody picked it up
+        std::lock_guard<std::mutex> lock(m_captureMutex);
+        if (m_latest >= 0 && m_captured[m_latest].sequence > m_published)
+            ++m_dropped;
+        m_captured[slot].sequence = ++m_sequence;
+        m_captured[slot].timestamp = timestamp;
+        m_latest = slot;
+    }
+}
+
+bool RedisCameraServer::pickUpCameraFrame()
+{
+    if (!m_capturing)
+    {
+        cv::Mat frame;
+        *m_camera >> frame;
+        if (frame.empty())
+            return false;
+        m_published = ++m_sequence;
+        m_publishedTime = now_us();
+        return publishFrame(frame, !m_yuv, m_sequence, m_publishedTime);
+    }
+
+    // Never waits for the camera: the freshest frame is published as is, or nothing if it already was
+    int slot;
+    {
+        std::lock_guard<std::mutex> lock(m_captureMutex);
+        if (m_latest < 0 || m_captured[m_latest].sequence <= m_published)
+            return false;
+        slot = m_reading = m_latest;
+        m_published = m_captured[slot].sequence;
+        m_publishedTime = m_captured[slot].timestamp;
+    }
+    const CapturedFrame& captured = m_captured[slot];
+    bool ok = publishFrame(captured.image, false, captured.sequence, captured.timestamp, captured.redisImage);
+
+    std::lock_guard<std::mutex> lock(m_captureMutex);
+    m_reading = -1;
+    return ok;
+}
+
+bool RedisCameraServer::publishFrame(const cv::Mat& frame, bool bgr, unsigned long long sequence, long long timestamp, Image* image)
 {
-    cv::Mat frame, RGBFrame;
-    *m_camera >> frame;
-    cv::cvtColor(frame, RGBFrame, CV_BGR2RGB);
+    unsigned long long ringSequence = 0;
+    if (m_ring && publishSharedFrame(frame, bgr, sequence, timestamp, ringSequence))
+        return !m_events || publishFrameEvent(m_shmName, frame.cols, m_yuv ? frame.rows * 2 / 3 : frame.rows, m_yuv ? 1 : 3, ringSequence);
+    if (m_yuv)
+        return false;
+
+    // Without a Redis image of its own (no background capture), the frame is converted into the reused one
+    if (image == NULL)
+    {
+        reuseImage(m_frameImage, m_frameBuffer, frame.cols, frame.rows);
+        if (bgr)
+            cv::cvtColor(frame, m_frameBuffer, CV_BGR2RGB);
+        else
+            frame.copyTo(m_frameBuffer);
+        image = m_frameImage;
+    }
 
-    Image* image = new Image(RGBFrame.cols, RGBFrame.rows, RGBFrame.channels(), RGBFrame.data);
     m_imageClient->setImage(image);
+    // setImage() waits for the SET, the frame is in Redis before the event goes out
+    return !m_events || publishFrameEvent(m_cameraKey, frame.cols, frame.rows, 3, 0);
+}
+
+bool RedisCameraServer::publishFrameEvent(const std::string& key, int width, int height, int channels, unsigned long long ringSequence)
+{
+    std::ostringstream event;
+    event << ++m_eventSequence << " " << key << " " << width << " " << height << " " << channels;
+    if (ringSequence != 0)
+        event << " " << ringSequence;
+    if (m_yuv)
+        event << " I420";
+    std::string value = event.str();
+    // Same connection as the shared memory metadata: the event never overtakes it
+    if (!m_metadata->append_publish(m_cameraKey + ":frames", value.data(), value.size()) || !m_metadata->flush())
+        return false;
+    while (m_metadata->pending() > 4)
+        m_metadata->read_reply();
+    return true;
+}
+
+bool RedisCameraServer::publishSharedFrame(const cv::Mat& frame, bool bgr, unsigned long long sequence, long long timestamp,
+                                           unsigned long long &ringSequence)
+{
+    //1. (Re)create the ring when the first frame, or a larger one, comes in.
+    // I420 frames are a single channel image of height * 3 / 2 rows: Y, then U & V.
+    int channels = m_yuv ? 1 : 3;
+    int height = m_yuv ? frame.rows * 2 / 3 : frame.rows;
+    size_t size = (size_t)frame.cols * frame.rows * channels;
+    if (!m_ring->is_open() || m_ring->slot_size() < size)
+    {
+        if (!m_ring->create(m_shmName, m_shmSlots, size))
+            return false;
+    }
+
+    //2. Write straight into the slot, a Mat wrapping preallocated memory of the right size is not reallocated
+    unsigned char* slot = m_ring->begin_write(frame.cols, frame.rows, channels);
+    cv::Mat slotFrame(frame.rows, frame.cols, m_yuv ? CV_8UC1 : CV_8UC3, slot);
+    if (bgr)
+        cv::cvtColor(frame, slotFrame, CV_BGR2RGB);
+    else
+        frame.copyTo(slotFrame);
+    ringSequence = m_ring->end_write();
+
+    //3. Only the metadata goes through Redis, without waiting for the acknowledgement
+    std::ostringstream metadata;
+    metadata << m_shmName << " " << ringSequence << " " << frame.cols << " " << height << " " << channels << " "
+             << sequence << " " << timestamp << (m_yuv ? " I420" : "");
+    std::string value = metadata.str();
+    if (!m_metadata->append_set(m_cameraKey + ":shm", value.data(), value.size()) || !m_metadata->flush())
+        return false;
+    while (m_metadata->pending() > 4)
+        m_metadata->read_reply();
+    return true;
 }
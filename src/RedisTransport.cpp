@@ -0,0 +1,243 @@
+#include "RedisTransport.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+
+RedisTransport::RedisTransport()
+    : m_context(NULL), m_reply(NULL), m_pending(0)
+{
+}
+
+RedisTransport::~RedisTransport()
+{
+    close();
+}
+
+bool RedisTransport::connect(const std::string& hostname, int port)
+{
+    close();
+    m_context = redisConnect(hostname.c_str(), port);
+    if (m_context == NULL || m_context->err)
+    {
+        std::cerr << "Could not connect to redis at " << hostname << ":" << port
+                  << (m_context ? std::string(": ") + m_context->errstr : std::string()) << std::endl;
+        if (m_context)
+            redisFree(m_context);
+        m_context = NULL;
+        return false;
+    }
+    return true;
+}
+
+void RedisTransport::close()
+{
+    if (m_reply)
+        freeReplyObject(m_reply);
+    m_reply = NULL;
+    if (m_context)
+        redisFree(m_context);
+    m_context = NULL;
+    m_pending = 0;
+}
+
+bool RedisTransport::append(int argc, const char** argv, const size_t* argvlen)
+{
+    if (!m_context)
+        return false;
+    if (redisAppendCommandArgv(m_context, argc, argv, argvlen) != REDIS_OK)
+    {
+        std::cerr << "Failed to queue redis command: " << m_context->errstr << std::endl;
+        return false;
+    }
+    ++m_pending;
+    return true;
+}
+
+bool RedisTransport::append_get(const std::string& key)
+{
+    const char* argv[] = { "GET", key.c_str() };
+    size_t argvlen[] = { 3, key.size() };
+    return append(2, argv, argvlen);
+}
+
+bool RedisTransport::append_set(const std::string& key, const void* data, size_t size)
+{
+    // Argv form: the payload goes from the caller buffer into the output buffer, no format string parsing
+    const char* argv[] = { "SET", key.c_str(), (const char*)data };
+    size_t argvlen[] = { 3, key.size(), size };
+    return append(3, argv, argvlen);
+}
+
+bool RedisTransport::append_publish(const std::string& channel, const void* data, size_t size)
+{
+    const char* argv[] = { "PUBLISH", channel.c_str(), (const char*)data };
+    size_t argvlen[] = { 7, channel.size(), size };
+    return append(3, argv, argvlen);
+}
+
+bool RedisTransport::subscribe(const std::string& channel)
+{
+    const char* argv[] = { "SUBSCRIBE", channel.c_str() };
+    size_t argvlen[] = { 9, channel.size() };
+    if (!drain() || !append(2, argv, argvlen))
+        return false;
+    // The confirmation comes as a message, read_message() skips it
+    --m_pending;
+    return flush();
+}
+
+redisReply* RedisTransport::buffered_reply()
+{
+    void* reply = NULL;
+    if (redisGetReplyFromReader(m_context, &reply) != REDIS_OK)
+    {
+        std::cerr << "Redis protocol error: " << m_context->errstr << std::endl;
+        close();
+        return NULL;
+    }
+    return (redisReply*)reply;
+}
+
+bool RedisTransport::read_message(std::string& payload, int timeout_ms)
+{
+    // Partial replies take several polls, all of them share the timeout
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (m_context)
+    {
+        //1. Replies already read from the socket come first
+        redisReply* reply = buffered_reply();
+        if (!m_context)
+            return false;
+
+        //2. Otherwise wait for the socket, without ever blocking in hiredis past the timeout
+        if (reply == NULL)
+        {
+            struct pollfd descriptor;
+            descriptor.fd = m_context->fd;
+            descriptor.events = POLLIN;
+            descriptor.revents = 0;
+            int remaining = -1;
+            if (timeout_ms >= 0)
+            {
+                // Rounded up, so that the last poll does not give up before the deadline
+                long long left = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+                remaining = left > 0 ? (int)((left + 999) / 1000) : 0;
+            }
+            int ready = poll(&descriptor, 1, remaining);
+            if (ready == 0)
+                return false;
+            // A signal is not a connection error, the deadline still bounds the retries
+            if (ready < 0 && errno == EINTR)
+                continue;
+            if (ready < 0 || redisBufferRead(m_context) != REDIS_OK)
+            {
+                std::cerr << "Redis connection error: " << (ready < 0 ? strerror(errno) : m_context->errstr) << std::endl;
+                close();
+                return false;
+            }
+            continue;
+        }
+
+        //3. ["message", channel, payload], anything else (subscription confirmations) is skipped
+        bool message = reply->type == REDIS_REPLY_ARRAY && reply->elements == 3
+                       && reply->element[0]->type == REDIS_REPLY_STRING && strcmp(reply->element[0]->str, "message") == 0
+                       && reply->element[2]->type == REDIS_REPLY_STRING;
+        if (message)
+            payload.assign(reply->element[2]->str, reply->element[2]->len);
+        freeReplyObject(reply);
+        if (message)
+            return true;
+    }
+    return false;
+}
+
+bool RedisTransport::flush()
+{
+    if (!m_context)
+        return false;
+    int done = 0;
+    while (!done)
+    {
+        if (redisBufferWrite(m_context, &done) != REDIS_OK)
+        {
+            std::cerr << "Redis connection error: " << m_context->errstr << std::endl;
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+redisReply* RedisTransport::next_reply()
+{
+    if (m_reply)
+        freeReplyObject(m_reply);
+    m_reply = NULL;
+    if (!m_context || m_pending == 0)
+        return NULL;
+
+    void* reply = NULL;
+    if (redisGetReply(m_context, &reply) != REDIS_OK || reply == NULL)
+    {
+        // The connection is unusable after an I/O or protocol error
+        std::cerr << "Redis connection error: " << m_context->errstr << std::endl;
+        close();
+        return NULL;
+    }
+    --m_pending;
+    m_reply = (redisReply*)reply;
+    if (m_reply->type == REDIS_REPLY_ERROR)
+    {
+        std::cerr << "Redis error: " << std::string(m_reply->str, m_reply->len) << std::endl;
+        return NULL;
+    }
+    return m_reply;
+}
+
+const unsigned char* RedisTransport::read_reply_in_place(size_t &size)
+{
+    redisReply* reply = next_reply();
+    size = 0;
+    if (!reply || reply->type != REDIS_REPLY_STRING)
+        return NULL;
+    size = reply->len;
+    return (const unsigned char*)reply->str;
+}
+
+bool RedisTransport::read_reply(void* dst, size_t capacity, size_t* size)
+{
+    redisReply* reply = next_reply();
+    if (!reply || reply->type == REDIS_REPLY_NIL)
+        return false;
+    if (size)
+        *size = reply->type == REDIS_REPLY_STRING ? reply->len : 0;
+    if (dst && reply->type == REDIS_REPLY_STRING)
+    {
+        if (reply->len > capacity)
+            return false;
+        memcpy(dst, reply->str, reply->len);
+    }
+    return true;
+}
+
+bool RedisTransport::drain()
+{
+    bool ok = true;
+    while (m_pending > 0 && m_context)
+        ok = read_reply() && ok;
+    return ok && m_context != NULL;
+}
+
+bool RedisTransport::get(const std::string& key, void* dst, size_t capacity, size_t* size)
+{
+    // Replies come in order, older pipelined commands are collected first
+    return drain() && append_get(key) && read_reply(dst, capacity, size);
+}
+
+bool RedisTransport::set(const std::string& key, const void* data, size_t size)
+{
+    return drain() && append_set(key, data, size) && read_reply();
+}
@@ -0,0 +1,250 @@
+#include "ShmFrameRing.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <limits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+const unsigned int RING_MAGIC = 0x49504652; // "IPFR"
+const unsigned int RING_VERSION = 1;
+const size_t PAGE = 4096;
+
+size_t round_up(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+}
+
+// Shared between processes: only fixed size types, atomics must be lock-free (checked by map()).
+struct ShmFrameRing::Header
+{
+    unsigned int magic, version;
+    unsigned int slot_count;
+    unsigned long long slot_size;  // Usable bytes of a slot
+    unsigned long long slot_stride; // Slot header & data, page aligned
+    std::atomic<unsigned long long> published; // Last published sequence
+};
+
+struct ShmFrameRing::Slot
+{
+    std::atomic<unsigned long long> sequence; // 2s + 1 while writing frame s, 2s once published
+    std::atomic<int> width, height, channels;
+    // Frame data starts at the next cache line
+};
+
+static const size_t SLOT_DATA_OFFSET = 64;
+
+// Slots & sizes whose whole ring (header page & page aligned slots) fits in a size_t
+static bool valid_geometry(size_t slots, size_t slot_size)
+{
+    return slots > 0 && slot_size > 0
+           && slot_size <= (std::numeric_limits<size_t>::max() - PAGE) / slots - PAGE - SLOT_DATA_OFFSET;
+}
+
+ShmFrameRing::ShmFrameRing()
+    : m_header(NULL), m_mapped_size(0), m_owner(false)
+{
+}
+
+ShmFrameRing::~ShmFrameRing()
+{
+    close();
+}
+
+bool ShmFrameRing::map(int fd, size_t size, bool writable)
+{
+    void* memory = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); // The mapping keeps the object alive
+    if (memory == MAP_FAILED)
+    {
+        std::cerr << "Failed to map shared memory " << m_name << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    m_header = (Header*)memory;
+    m_mapped_size = size;
+    if (!m_header->published.is_lock_free())
+    {
+        std::cerr << "64 bits atomics are not lock-free on this platform, cannot share them between processes." << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool ShmFrameRing::create(const std::string& name, int slots, size_t slot_size)
+{
+    close();
+    if (slots <= 0 || !valid_geometry(slots, slot_size))
+    {
+        std::cerr << "Invalid ring geometry for " << name << ": " << slots << " slots of " << slot_size << " bytes." << std::endl;
+        return false;
+    }
+    m_name = name;
+
+    //1. Start from a fresh object, a previous producer may have crashed with another geometry
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+    {
+        std::cerr << "Failed to create shared memory " << name << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    size_t stride = round_up(SLOT_DATA_OFFSET + slot_size, PAGE);
+    size_t size = PAGE + stride * slots;
+    if (ftruncate(fd, size) != 0)
+    {
+        std::cerr << "Failed to size shared memory " << name << ": " << strerror(errno) << std::endl;
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    if (!map(fd, size, true))
+    {
+        shm_unlink(name.c_str());
+        return false;
+    }
+    m_owner = true;
+
+    //2. ftruncate zero-fills: every slot sequence is 0 (empty). The magic goes last, consumers check it.
+    m_header->version = RING_VERSION;
+    m_header->slot_count = slots;
+    m_header->slot_size = slot_size;
+    m_header->slot_stride = stride;
+    m_header->published.store(0);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->magic = RING_MAGIC;
+    return true;
+}
+
+bool ShmFrameRing::open(const std::string& name)
+{
+    close();
+    m_name = name;
+
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        std::cerr << "Failed to open shared memory " << name << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < PAGE)
+    {
+        std::cerr << "Invalid shared memory " << name << "." << std::endl;
+        ::close(fd);
+        return false;
+    }
+    if (!map(fd, info.st_size, false))
+        return false;
+
+    // The header comes from another process: its geometry gets the checks of create(), and every slot,
+    // data included, must lie within the mapping
+    size_t slots = m_header->slot_count, slot_size = m_header->slot_size, stride = m_header->slot_stride;
+    if (m_header->magic != RING_MAGIC || m_header->version != RING_VERSION || !valid_geometry(slots, slot_size)
+        || m_header->slot_size != slot_size || m_header->slot_stride != stride
+        || stride < SLOT_DATA_OFFSET + slot_size || stride > (m_mapped_size - PAGE) / slots)
+    {
+        std::cerr << "Shared memory " << name << " is not a frame ring." << std::endl;
+        close();
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return true;
+}
+
+void ShmFrameRing::close()
+{
+    if (m_header)
+        munmap(m_header, m_mapped_size);
+    if (m_owner)
+        shm_unlink(m_name.c_str());
+    m_header = NULL;
+    m_mapped_size = 0;
+    m_owner = false;
+}
+
+ShmFrameRing::Slot* ShmFrameRing::slot(unsigned long long sequence) const
+{
+    unsigned char* base = (unsigned char*)m_header + PAGE;
+    return (Slot*)(base + (sequence % m_header->slot_count) * m_header->slot_stride);
+}
+
+unsigned char* ShmFrameRing::begin_write(int width, int height, int channels)
+{
+    if (!m_owner || (size_t)width * height * channels > m_header->slot_size)
+        return NULL;
+
+    unsigned long long sequence = m_header->published.load(std::memory_order_relaxed) + 1;
+    Slot* target = slot(sequence);
+    // Mark the slot busy before touching the data, readers of the previous frame there will notice
+    target->sequence.store(2 * sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    target->width.store(width, std::memory_order_relaxed);
+    target->height.store(height, std::memory_order_relaxed);
+    target->channels.store(channels, std::memory_order_relaxed);
+    return (unsigned char*)target + SLOT_DATA_OFFSET;
+}
+
+unsigned long long ShmFrameRing::end_write()
+{
+    unsigned long long sequence = m_header->published.load(std::memory_order_relaxed) + 1;
+    slot(sequence)->sequence.store(2 * sequence, std::memory_order_release);
+    m_header->published.store(sequence, std::memory_order_release);
+    return sequence;
+}
+
+const unsigned char* ShmFrameRing::frame(unsigned long long sequence, int &width, int &height, int &channels) const
+{
+    if (!m_header || sequence == 0)
+        return NULL;
+    Slot* source = slot(sequence);
+    if (source->sequence.load(std::memory_order_acquire) != 2 * sequence)
+        return NULL;
+    width = source->width.load(std::memory_order_relaxed);
+    height = source->height.load(std::memory_order_relaxed);
+    channels = source->channels.load(std::memory_order_relaxed);
+    if ((size_t)width * height * channels > m_header->slot_size || !valid(sequence))
+        return NULL;
+    return (const unsigned char*)source + SLOT_DATA_OFFSET;
+}
+
+bool ShmFrameRing::valid(unsigned long long sequence) const
+{
+    if (!m_header || sequence == 0)
+        return false;
+    // Order every read of the frame before the check
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot(sequence)->sequence.load(std::memory_order_relaxed) == 2 * sequence;
+}
+
+bool ShmFrameRing::read(unsigned long long sequence, unsigned char* dst, size_t capacity, int &width, int &height, int &channels) const
+{
+    const unsigned char* data = frame(sequence, width, height, channels);
+    size_t size = (size_t)width * height * channels;
+    if (!data || size > capacity)
+        return false;
+    memcpy(dst, data, size);
+    return valid(sequence);
+}
+
+unsigned long long ShmFrameRing::latest() const
+{
+    return m_header ? m_header->published.load(std::memory_order_acquire) : 0;
+}
+
+int ShmFrameRing::slots() const
+{
+    return m_header ? (int)m_header->slot_count : 0;
+}
+
+size_t ShmFrameRing::slot_size() const
+{
+    return m_header ? (size_t)m_header->slot_size : 0;
+}
@@ -0,0 +1,108 @@
+#include "TexturePool.hpp"
+#include "gles_utils.hpp"
+
+TexturePool::TexturePool(size_t budget)
+    : m_free_bytes(0), m_budget(budget)
+{
+}
+
+TexturePool::~TexturePool()
+{
+    // GL objects can only be deleted with their context current, which the owner takes care of
+    // by calling clear() before tearing EGL down.
+}
+
+RenderTarget TexturePool::acquire_texture(int width, int height, GLenum format, GLenum type)
+{
+    return acquire(width, height, format, type, false);
+}
+
+RenderTarget TexturePool::acquire_target(int width, int height, GLenum format, GLenum type)
+{
+    return acquire(width, height, format, type, true);
+}
+
+RenderTarget TexturePool::acquire(int width, int height, GLenum format, GLenum type, bool with_fbo)
+{
+    for (std::list<RenderTarget>::iterator it = m_free.begin() ; it != m_free.end() ; ++it)
+    {
+        if (it->width == width && it->height == height && it->format == format && it->type == type
+            && (it->fbo != 0) == with_fbo)
+        {
+            RenderTarget target = *it;
+            m_free_bytes -= byte_size(target);
+            m_free.erase(it);
+            return target;
+        }
+    }
+
+    RenderTarget target = { 0, 0, width, height, format, type };
+    if (with_fbo)
+    {
+        target.fbo = init_fbo(width, height, target.texture, format, type);
+        if (!target.fbo)
+            target.texture = 0;
+        return target;
+    }
+
+    glGenTextures(1, &target.texture);
+    glBindTexture(GL_TEXTURE_2D, target.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // Storage is allocated once here, frames are then streamed with glTexSubImage2D
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, pixel_format(format), type, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return target;
+}
+
+void TexturePool::release(const RenderTarget& target)
+{
+    if (!target.texture)
+        return;
+
+    m_free.push_front(target);
+    m_free_bytes += byte_size(target);
+    while (m_free_bytes > m_budget && !m_free.empty())
+    {
+        m_free_bytes -= byte_size(m_free.back());
+        destroy(m_free.back());
+        m_free.pop_back();
+    }
+}
+
+void TexturePool::clear()
+{
+    for (std::list<RenderTarget>::iterator it = m_free.begin() ; it != m_free.end() ; ++it)
+        destroy(*it);
+    m_free.clear();
+    m_free_bytes = 0;
+}
+
+size_t TexturePool::byte_size(const RenderTarget& target)
+{
+    size_t channels = 3;
+    if (target.format == GL_RGBA || target.format == GL_RGBA32F_EXT)
+        channels = 4;
+    else if (target.format == GL_LUMINANCE || target.format == GL_ALPHA)
+        channels = 1;
+    else if (target.format == GL_LUMINANCE_ALPHA)
+        channels = 2;
+
+    size_t channel_size = 1;
+    if (target.type == GL_FLOAT)
+        channel_size = 4;
+    else if (target.type == GL_HALF_FLOAT || target.type == GL_HALF_FLOAT_OES)
+        channel_size = 2;
+
+    return (size_t)target.width * target.height * channels * channel_size;
+}
+
+void TexturePool::destroy(const RenderTarget& target)
+{
+    if (target.fbo)
+        delete_fbo(target.fbo, target.texture);
+    else
+        glDeleteTextures(1, &target.texture);
+}
@@ -0,0 +1,228 @@
+#include "TileScheduler.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+namespace
+{
+// Scheduler whose worker the current thread is (NULL outside of any pool) & the index of its queue there.
+// The index is only meaningful for that scheduler, the others treat the thread as an outside caller.
+thread_local const TileScheduler* t_owner = NULL;
+thread_local int t_queue = -1;
+
+// Above this, IPOGLES_THREADS is taken for a typo rather than a thread count
+const long MAX_THREADS = 256;
+
+// Thread count asked by IPOGLES_THREADS, 0 (one per core) when unset or invalid
+unsigned env_threads()
+{
+    const char* value = getenv("IPOGLES_THREADS");
+    if (!value)
+        return 0;
+    char* end;
+    long threads = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || threads <= 0 || threads > MAX_THREADS) {
+        std::cerr << "Ignoring IPOGLES_THREADS=" << value << ", expected 1 to " << MAX_THREADS << " threads." << std::endl;
+        return 0;
+    }
+    return (unsigned)threads;
+}
+}
+
+std::vector<Tile> make_tiles(int width, int height, int tile_width, int tile_height, int halo)
+{
+    std::vector<Tile> tiles;
+    if (tile_width <= 0) tile_width = width;
+    if (tile_height <= 0) tile_height = height;
+
+    for (int y = 0 ; y < height ; y += tile_height)
+    {
+        for (int x = 0 ; x < width ; x += tile_width)
+        {
+            Tile tile;
+            tile.x = x;
+            tile.y = y;
+            tile.width = std::min(tile_width, width - x);
+            tile.height = std::min(tile_height, height - y);
+            tile.halo_x = std::max(0, x - halo);
+            tile.halo_y = std::max(0, y - halo);
+            tile.halo_width = std::min(width, x + tile.width + halo) - tile.halo_x;
+            tile.halo_height = std::min(height, y + tile.height + halo) - tile.halo_y;
+            tiles.push_back(tile);
+        }
+    }
+    return tiles;
+}
+
+TileScheduler::TileScheduler(unsigned threads)
+    : m_pending(0), m_stop(false)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+
+    for (unsigned i = 0 ; i < threads ; ++i)
+        m_queues.push_back(new Queue());
+    // The calling thread is a participant as well, so one thread less is spawned.
+    for (unsigned i = 0 ; i + 1 < threads ; ++i)
+        m_threads.push_back(std::thread(&TileScheduler::worker_loop, this, i));
+}
+
+TileScheduler::~TileScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (size_t i = 0 ; i < m_threads.size() ; ++i)
+        m_threads[i].join();
+    for (size_t i = 0 ; i < m_queues.size() ; ++i)
+        delete m_queues[i];
+}
+
+TileScheduler& TileScheduler::global()
+{
+    static TileScheduler scheduler(env_threads());
+    return scheduler;
+}
+
+int TileScheduler::tile_rows(size_t bytes_per_row)
+{
+    const size_t tile_bytes = 256 * 1024;
+    if (bytes_per_row == 0 || bytes_per_row >= tile_bytes)
+        return 1;
+    return (int)(tile_bytes / bytes_per_row);
+}
+
+void TileScheduler::worker_loop(unsigned id)
+{
+    t_owner = this;
+    t_queue = id;
+    Task task;
+    while (true)
+    {
+        if (pop_or_steal(id, task)) {
+            run(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_wake.wait(lock, [this] { return m_pending > 0 || m_stop; });
+        if (m_stop)
+            return;
+    }
+}
+
+bool TileScheduler::pop_or_steal(unsigned id, Task &task)
+{
+    const size_t count = m_queues.size();
+    bool found = false;
+
+    // Own queue first, from the back (last dealt tiles, still warm)...
+    {
+        Queue& own = *m_queues[id];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            found = true;
+        }
+    }
+    // ...then steal from the front of the others.
+    for (size_t i = 1 ; i < count && !found ; ++i)
+    {
+        Queue& victim = *m_queues[(id + i) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            found = true;
+        }
+    }
+
+    if (found) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        --m_pending;
+    }
+    return found;
+}
+
+void TileScheduler::run(const Task& task)
+{
+    Batch* batch = task.batch;
+    (*batch->func)(task.index);
+    if (--batch->remaining == 0) {
+        // The batch lives on the stack of its caller & may be gone as soon as remaining is 0.
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_done.notify_all();
+    }
+}
+
+void TileScheduler::parallel_for(size_t count, const std::function<void(size_t)>& func)
+{
+    if (count == 0)
+        return;
+    if (count == 1 || m_queues.size() == 1) {
+        for (size_t i = 0 ; i < count ; ++i)
+            func(i);
+        return;
+    }
+
+    Batch batch;
+    batch.func = &func;
+    batch.remaining = count;
+
+    // Deal contiguous blocks of tiles to each queue so that neighbouring tiles stay on the same thread.
+    // m_mutex is held so that m_pending is raised before any of these tasks can be accounted as popped.
+    const size_t queues = m_queues.size();
+    {
+        std::lock_guard<std::mutex> pending_lock(m_mutex);
+        for (size_t q = 0 ; q < queues ; ++q)
+        {
+            size_t begin = q * count / queues, end = (q + 1) * count / queues;
+            Queue& queue = *m_queues[q];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            for (size_t i = begin ; i < end ; ++i)
+            {
+                Task task = { &batch, i };
+                queue.tasks.push_back(task);
+            }
+        }
+        m_pending += count;
+    }
+    m_wake.notify_all();
+
+    // Help until the batch is over. Tasks of other batches may be run as well, which is fine.
+    const unsigned id = (t_owner == this) ? (unsigned)t_queue : (unsigned)(queues - 1);
+    Task task;
+    while (batch.remaining > 0)
+    {
+        if (pop_or_steal(id, task)) {
+            run(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [&batch, this] { return batch.remaining == 0 || m_pending > 0; });
+    }
+}
+
+void TileScheduler::parallel_for_range(size_t size, size_t grain, const std::function<void(size_t, size_t)>& func)
+{
+    if (grain == 0)
+        grain = 1;
+    size_t chunks = (size + grain - 1) / grain;
+    parallel_for(chunks, [&](size_t i) {
+        size_t begin = i * grain;
+        func(begin, std::min(size, begin + grain));
+    });
+}
+
+void TileScheduler::for_each_tile(int width, int height, int tile_width, int tile_height, int halo,
+                                  const std::function<void(const Tile&)>& func)
+{
+    std::vector<Tile> tiles = make_tiles(width, height, tile_width, tile_height, halo);
+    parallel_for(tiles.size(), [&](size_t i) { func(tiles[i]); });
+}
@@ -1,238 +1,570 @@
 #include <iomanip>
 #include <chrono>
 #include <fstream>
-
-#include "quad.hpp"
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <vector>
+
+#include "GpuFilterContext.hpp"
+#include "GpuWorkerPool.hpp"
+#include "GaussianBlur.hpp"
+#include "GpuReduction.hpp"
 #include "gles_utils.hpp"
+#include "cpu_filters.hpp"
 #include "ImageUtils.hpp"
 
+typedef std::chrono::high_resolution_clock Time;
+typedef std::chrono::duration<double, std::milli> fms;
 
-int main(int argc, char** argv)
+/**
+    Distribution of the per-frame timings of one size, in milliseconds.
+*/
+struct Stats
 {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <vertex shader path> <fragment shader path>" << std::endl;
-        return EXIT_FAILURE;
-    }
+    double min, median, p95, p99, mean, stddev;
+};
+
+/**
+    Compute the statistics of a set of samples. Percentiles use the nearest-rank method.
+    @param samples the timings (sorted by this func)
+    @return the statistics of the samples
+*/
+static Stats compute_stats(std::vector<double> &samples)
+{
+    Stats stats = {0, 0, 0, 0, 0, 0};
+    if (samples.empty())
+        return stats;
+
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    auto percentile = [&](double p) { return samples[std::min(n - 1, (size_t)std::ceil(p * n) - 1)]; };
+
+    double sum = 0, sum_sq = 0;
+    for (size_t i = 0 ; i < n ; ++i)
+        sum += samples[i];
+    stats.mean = sum / n;
+    for (size_t i = 0 ; i < n ; ++i)
+        sum_sq += (samples[i] - stats.mean) * (samples[i] - stats.mean);
+
+    stats.min = samples[0];
+    stats.median = (n % 2) ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    stats.p95 = percentile(0.95);
+    stats.p99 = percentile(0.99);
+    stats.stddev = n > 1 ? std::sqrt(sum_sq / (n - 1)) : 0;
+    return stats;
+}
 
-    std::fstream csvfile;
-    csvfile.open("bench.csv", std::fstream::in | std::fstream::out | std::fstream::app);
-    if (!csvfile.is_open())
+/**
+    Per-stage statistics of one benchmarked configuration.
+*/
+struct Measure
+{
+    Stats upload, compute, readback, total;
+};
+
+/**
+    Convert a float to IEEE 754 half precision (round toward zero, no denormals).
+    Only used to prepare half float input images.
+*/
+static unsigned short float_to_half(float value)
+{
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+    unsigned short sign = (bits >> 16) & 0x8000;
+    int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+    if (exponent <= 0)
+        return sign;
+    if (exponent >= 31)
+        return sign | 0x7c00;
+    return sign | (exponent << 10) | ((bits >> 13) & 0x3ff);
+}
+
+/**
+    Size in bytes of one channel for a pixel transfer type.
+*/
+static size_t type_size(GLenum type)
+{
+    if (type == GL_FLOAT)
+        return sizeof(GLfloat);
+    if (type == GL_HALF_FLOAT || type == GL_HALF_FLOAT_OES)
+        return sizeof(unsigned short);
+    return sizeof(GLubyte);
+}
+
+/**
+    Benchmark the loaded filter chain on a random image.
+    Every stage ends with a synchronisation point so that the clock is read once the GPU is
+    actually done, not when the command was queued.
+    @param gpu the initialized context with its passes loaded
+    @param width the width of the image
+    @param height the height of the image
+    @param type the upload & readback type (GL_UNSIGNED_BYTE, GL_FLOAT or a half float type)
+    @param warmup the number of discarded iterations
+    @param iterations the number of measured iterations
+    @param measure the per-stage statistics (filled by this func)
+    @return false if the driver rejected the format
+*/
+static bool bench_gpu(GpuFilterContext& gpu, int width, int height, GLenum type, int warmup, int iterations, Measure &measure)
+{
+    // Setup, not timed: input generation (normalized to [0, 1] for floating point types), buffers, textures & FBOs.
+    size_t size = (size_t)width * height * 3;
+    float* random = generate_random_image(width, height, 3);
+    std::vector<unsigned char> image(size * type_size(type)), data(size * type_size(type));
+    for (size_t i = 0 ; i < size ; ++i)
     {
-        std::cerr << "Could not opencv bench.csv, benchmark results are not going to be saved" << std::endl;
+        if (type == GL_FLOAT)
+            ((float*)&image[0])[i] = random[i] / 255.f;
+        else if (type == GL_UNSIGNED_BYTE)
+            image[i] = (unsigned char)random[i];
+        else
+            ((unsigned short*)&image[0])[i] = float_to_half(random[i] / 255.f);
+    }
+    delete[] random;
+
+    while (glGetError() != GL_NO_ERROR);
+    if (!gpu.upload(&image[0], width, height, type))
+        return false;
+    gpu.draw();
+    gpu.read(&data[0], type);
+    if (glGetError() != GL_NO_ERROR)
+        return false;
+
+    std::vector<double> upload_times, compute_times, readback_times, total_times;
+    for (int i = 0 ; i < warmup + iterations ; ++i)
+    {
+        auto upload_start = Time::now();
+        gpu.upload(&image[0], width, height, type);
+        glFinish();
+        auto compute_start = Time::now();
+        gpu.draw();
+        glFinish();
+        auto readback_start = Time::now();
+        gpu.read(&data[0], type);
+        auto readback_end = Time::now();
+
+        if (i < warmup)
+            continue;
+        upload_times.push_back(fms(compute_start - upload_start).count());
+        compute_times.push_back(fms(readback_start - compute_start).count());
+        readback_times.push_back(fms(readback_end - readback_start).count());
+        total_times.push_back(fms(readback_end - upload_start).count());
     }
 
+    measure.upload = compute_stats(upload_times);
+    measure.compute = compute_stats(compute_times);
+    measure.readback = compute_stats(readback_times);
+    measure.total = compute_stats(total_times);
+    return true;
+}
 
-    //1. Get a EGL valid display
-    EGLDisplay display;
-    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
-    if (display == EGL_NO_DISPLAY) {
-        std::cerr << "Failed to get EGL Display" << std::endl
-            << "Error: " << eglGetError() << std::endl;
-        return EXIT_FAILURE;
+/**
+    Benchmark a CPU filter on a random 8 bits image. There is no transfer, everything is compute time.
+*/
+static void bench_cpu(CpuFilter filter, int width, int height, int warmup, int iterations, Measure &measure)
+{
+    size_t size = (size_t)width * height * 3;
+    unsigned char* image = new unsigned char[size];
+    fill_random_image(image, width, height, 3);
+    unsigned char* data = new unsigned char[size];
+
+    std::vector<double> zeros(iterations, 0.), compute_times;
+    for (int i = 0 ; i < warmup + iterations ; ++i)
+    {
+        auto compute_start = Time::now();
+        cpu_filter(filter, image, data, width, height);
+        if (i >= warmup)
+            compute_times.push_back(fms(Time::now() - compute_start).count());
     }
-    else {
-        std::cerr << "Successfully get EGL Display." << std::endl;
+    delete[] image;
+    delete[] data;
+
+    measure.upload = measure.readback = compute_stats(zeros);
+    measure.compute = compute_stats(compute_times);
+    measure.total = measure.compute;
+}
+
+static void write_json_stats(std::ostream& out, const char* name, const Stats& stats)
+{
+    out << "\"" << name << "\": {"
+        << "\"min\": " << stats.min << ", \"median\": " << stats.median
+        << ", \"p95\": " << stats.p95 << ", \"p99\": " << stats.p99
+        << ", \"mean\": " << stats.mean << ", \"stddev\": " << stats.stddev << "}";
+}
+
+static std::string json_escape(const std::string& value)
+{
+    std::string escaped;
+    for (size_t i = 0 ; i < value.size() ; ++i)
+    {
+        if (value[i] == '"' || value[i] == '\\')
+            escaped += '\\';
+        escaped += value[i];
     }
+    return escaped;
+}
 
+/**
+    Sweep the filter shaders of a directory over a set of sizes & transfer formats,
+    and write one JSON object per configuration into bench.json.
+    gaussian_separable.frag is benchmarked as a blur of sigma 4 (two passes).
+*/
+static int bench_matrix(const std::string& vertex_shader_path, const std::string& shader_dir, int warmup, int iterations)
+{
+    // Only the RGB to RGB filters: the other shaders of the directory (yuv_to_rgb, downsample, reduce,
+    // histogram) need their own uniforms, vertex shader or target size
+    const char* filters[] = { "gaussian3.frag", "gaussian5.frag", "gaussian_separable.frag", "sobel.frag", "test.frag" };
+    std::vector<std::string> shaders(filters, filters + sizeof(filters) / sizeof(filters[0]));
 
-    //2. Initialize EGL. Create a connection to the display.
-    int minor, major;
-    if (eglInitialize(display, &minor, &major) == EGL_FALSE) {
-        std::cerr << "Failed to initialize EGL Display" << std::endl
-            << "Error: " << eglGetError() << std::endl;
-        eglTerminate(display);
+    GpuFilterContext gpu;
+    if (!gpu.init())
         return EXIT_FAILURE;
-    }
-    else {
-        std::cerr << "Successfully intialized display (OpenGL ES version " << minor << "." << major << ")." << std::endl;
-    }
 
-    //3. Find a config that match specified requirements (in gles_utils.hpp).
-    // OpenGL ES Config are used to specify things like multi sampling, channel size, stencil buffer usage, & more
-    // See the doc: https://www.khronos.org/registry/EGL/sdk/docs/man/html/eglChooseConfig.xhtml for more informations
-    EGLConfig config;
-    EGLint num_configs;
-    if (!eglChooseConfig(display, EGL_CONFIG_ATTRIBUTES, &config, 1, &num_configs)) {
-        std::cerr << "Failed to choose EGL Config" << std::endl
-            << "Error: " << eglGetError() << std::endl;
-        eglTerminate(display);
+    // Square powers of two, then the usual video sizes (non square, non power of two)
+    std::vector<std::pair<int, int> > sizes;
+    for (int N = 128 ; N <= 8192 ; N += N)
+        sizes.push_back(std::make_pair(N, N));
+    sizes.push_back(std::make_pair(1280, 720));
+    sizes.push_back(std::make_pair(1920, 1080));
+    sizes.push_back(std::make_pair(3840, 2160));
+
+    std::vector<std::pair<GLenum, std::string> > formats;
+    formats.push_back(std::make_pair((GLenum)GL_UNSIGNED_BYTE, std::string("GL_UNSIGNED_BYTE")));
+    formats.push_back(std::make_pair((GLenum)GL_FLOAT, std::string("GL_FLOAT")));
+    GLenum half_type = half_float_type();
+    if (half_type)
+        formats.push_back(std::make_pair(half_type, std::string(half_type == GL_HALF_FLOAT ? "GL_HALF_FLOAT" : "GL_HALF_FLOAT_OES")));
+    else
+        std::cerr << "Half float transfers are not supported by this context, skipping them." << std::endl;
+
+    std::ofstream json("bench.json");
+    if (!json.is_open()) {
+        std::cerr << "Could not open bench.json" << std::endl;
         return EXIT_FAILURE;
     }
-    else {
-        std::cerr << "Successfully choose OpenGL ES Config ("<< num_configs << ")." << std::endl;
-    }
+    json << std::fixed << std::setprecision(4);
+    json << "{" << std::endl
+         << "  \"timestamp\": " << (long)time(NULL) << "," << std::endl
+         << "  \"gl_vendor\": \"" << json_escape((const char*)glGetString(GL_VENDOR)) << "\"," << std::endl
+         << "  \"gl_renderer\": \"" << json_escape((const char*)glGetString(GL_RENDERER)) << "\"," << std::endl
+         << "  \"gl_version\": \"" << json_escape((const char*)glGetString(GL_VERSION)) << "\"," << std::endl
+         << "  \"results\": [";
+
+    bool first = true;
+    for (size_t s = 0 ; s < shaders.size() ; ++s)
+    {
+        std::string path = shader_dir + "/" + shaders[s];
+        bool loaded = (shaders[s] == "gaussian_separable.frag")
+            ? (gpu.clear_passes(), add_gaussian_blur(gpu, vertex_shader_path, path, 4.f))
+            : gpu.load_program(vertex_shader_path, path);
+        if (!loaded) {
+            std::cerr << "Skipping " << path << std::endl;
+            continue;
+        }
 
-    //4. Creating an OpenGL Render Surface with surface attributes defined above to draw to.
-    EGLint pbufferAttributes[] = {EGL_WIDTH, 10000, EGL_HEIGHT, 10000, EGL_NONE};
-    EGLSurface surface = eglCreatePbufferSurface(display, config, pbufferAttributes);
-    if (surface == EGL_NO_SURFACE) {
-        std::cerr << "Failed to create EGL Surface." << std::endl
-            << "Error: " << eglGetError() << std::endl;
-    }
-    else {
-        std::cerr << "Successfully created OpenGL ES Surface." << std::endl;
+        for (size_t z = 0 ; z < sizes.size() ; ++z)
+        {
+            for (size_t f = 0 ; f < formats.size() ; ++f)
+            {
+                int width = sizes[z].first, height = sizes[z].second;
+                Measure measure;
+                bool supported = bench_gpu(gpu, width, height, formats[f].first, warmup, iterations, measure);
+                double megabytes = width * height * 3 * type_size(formats[f].first) / 1e6;
+
+                std::cout << shaders[s] << "\t" << width << "x" << height << "\t" << formats[f].second << "\t"
+                          << (supported ? "" : "unsupported") << std::endl;
+
+                json << (first ? "" : ",") << std::endl << "    {"
+                     << "\"backend\": \"gpu\", "
+                     << "\"shader\": \"" << json_escape(shaders[s]) << "\", "
+                     << "\"passes\": " << gpu.pass_count() << ", "
+                     << "\"width\": " << width << ", \"height\": " << height << ", "
+                     << "\"format\": \"" << formats[f].second << "\", "
+                     << "\"channels\": 3, "
+                     << "\"megabytes\": " << megabytes << ", "
+                     << "\"warmup\": " << warmup << ", \"iterations\": " << iterations << ", "
+                     << "\"supported\": " << (supported ? "true" : "false");
+                if (supported)
+                {
+                    json << ", ";
+                    write_json_stats(json, "upload", measure.upload);
+                    json << ", ";
+                    write_json_stats(json, "compute", measure.compute);
+                    json << ", ";
+                    write_json_stats(json, "readback", measure.readback);
+                    json << ", ";
+                    write_json_stats(json, "total", measure.total);
+                    json << ", \"bandwidth_mbps\": " << megabytes / (measure.total.median / 1e3);
+                }
+                json << "}";
+                first = false;
+            }
+        }
     }
+    json << std::endl << "  ]" << std::endl << "}" << std::endl;
 
-    //5. Make OpenGL ES the current API.
-    eglBindAPI(EGL_OPENGL_API);
+    std::cout << "Results written to bench.json" << std::endl;
+    return EXIT_SUCCESS;
+}
 
-    //6. Create a context.
-    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
-    if (context == EGL_NO_CONTEXT) {
-        std::cerr << "Failed to create EGL Context." << std::endl
-            << "Error: " << eglGetError() << std::endl;
-    }
-    else {
-        std::cerr << "Successfully created OpenGL ES Context." << std::endl;
+/**
+    Throughput of the multi-context worker pool on 1080p frames, for 1, 2, 4... workers up to
+    the number of cores. Frames are kept in flight up to the pool capacity.
+*/
+static int bench_pool(const std::string& vertex_shader_path, const std::string& fragment_shader_path, int warmup, int iterations)
+{
+    const int width = 1920, height = 1080;
+    unsigned max_workers = std::max(2u, std::thread::hardware_concurrency());
+
+    std::cout << std::endl
+              << "** Starting pool benchmark **" << std::endl
+              << "Convolution using " << fragment_shader_path << " on " << width << "x" << height << " frames" << std::endl
+              << "---------------------------------------------" << std::endl
+              << "Workers		Frames		Time (ms)	Frames/s" << std::endl
+              << std::fixed << std::setprecision(3);
+
+    for (unsigned workers = 1 ; workers <= max_workers ; workers *= 2)
+    {
+        GpuWorkerPool pool;
+        bool ok = pool.start(workers, [&](GpuFilterContext& gpu) {
+            return gpu.load_program(vertex_shader_path, fragment_shader_path);
+        });
+        if (!ok)
+            return EXIT_FAILURE;
+
+        // One buffer pair per frame in flight, the workers never share one
+        std::vector<std::vector<unsigned char> > src(pool.capacity()), dst(pool.capacity());
+        for (size_t i = 0 ; i < pool.capacity() ; ++i)
+        {
+            src[i].resize(width * height * 3);
+            fill_random_image(&src[i][0], width, height, 3);
+            dst[i].resize(width * height * 3);
+        }
+
+        int frames = (warmup + iterations) * workers;
+        Time::time_point start;
+        for (int i = 0 ; i < frames ; ++i)
+        {
+            if (i == warmup * (int)workers)
+                start = Time::now();
+            GpuFrame frame;
+            if (pool.in_flight() == pool.capacity() && (!pool.next(frame) || !frame.ok))
+                return EXIT_FAILURE;
+            size_t slot = i % pool.capacity();
+            pool.submit(&src[slot][0], &dst[slot][0], width, height);
+        }
+        GpuFrame frame;
+        while (pool.next(frame))
+            if (!frame.ok)
+                return EXIT_FAILURE;
+        double elapsed = fms(Time::now() - start).count();
+
+        int measured = iterations * workers;
+        std::cout << workers << "\t\t" << measured << "\t\t" << elapsed << "\t\t" << measured / (elapsed / 1e3) << std::endl;
     }
+    return EXIT_SUCCESS;
+}
 
-    //7. Bind context to to the current thread.
-    bool result = eglMakeCurrent(display, surface, surface, context);
-    if (!result) {
-        std::cerr << "Failed to make the egl context to the current one." << std::endl;
-        eglTerminate(display);
+/**
+    Statistics of a filtered frame computed on the GPU against reading the whole frame back,
+    at 720p & 1080p: reduce() for each operation, histogram() for a few sampling steps.
+    The times include the (small) readback of the result, which waits for the GPU.
+*/
+static int bench_stats(const std::string& vertex_shader_path, const std::string& shader_dir, int warmup, int iterations)
+{
+    GpuFilterContext gpu;
+    GpuReduction reduction(gpu);
+    if (!gpu.init() || !gpu.load_program(vertex_shader_path, shader_dir + "/gaussian3.frag")
+        || !reduction.load_reduce_program(vertex_shader_path, shader_dir + "/reduce.frag"))
         return EXIT_FAILURE;
+    bool histograms = reduction.load_histogram_program(shader_dir + "/histogram.vert", shader_dir + "/histogram.frag");
+    if (!histograms)
+        std::cerr << "Skipping the histograms." << std::endl;
+
+    std::cout << std::endl
+              << "** Starting statistics benchmark **" << std::endl
+              << "---------------------------------------------" << std::endl
+              << "Size		Statistic		Median (ms)	P95 (ms)" << std::endl
+              << std::fixed << std::setprecision(3);
+
+    const int sizes[][2] = { { 1280, 720 }, { 1920, 1080 } };
+    const char* reductions[] = { "min", "max", "mean" };
+    const int steps[] = { 1, 2, 4, 8 };
+    for (int z = 0 ; z < 2 ; ++z)
+    {
+        int width = sizes[z][0], height = sizes[z][1];
+        std::vector<unsigned char> src(width * height * 3), dst(width * height * 3);
+        fill_random_image(&src[0], width, height, 3);
+        if (!gpu.upload(&src[0], width, height))
+            return EXIT_FAILURE;
+        gpu.draw();
+
+        // Full readback first, then each reduction & histogram: all of them start from the same drawn result
+        unsigned int bins[HISTOGRAM_BINS];
+        float result[3];
+        int count = 1 + 3 + (histograms ? 4 : 0);
+        for (int k = 0 ; k < count ; ++k)
+        {
+            std::ostringstream name;
+            std::vector<double> samples;
+            for (int i = 0 ; i < warmup + iterations ; ++i)
+            {
+                glFinish();
+                Time::time_point start = Time::now();
+                if (k == 0)
+                    gpu.read(&dst[0]);
+                else if (k < 4)
+                    reduction.reduce(gpu.result(), (ReductionOp)(k - 1), result);
+                else
+                    reduction.histogram(gpu.result(), bins, steps[k - 4]);
+                if (i >= warmup)
+                    samples.push_back(fms(Time::now() - start).count());
+            }
+            if (k == 0)
+                name << "read()		";
+            else if (k < 4)
+                name << "reduce(" << reductions[k - 1] << ")	";
+            else
+                name << "histogram(step " << steps[k - 4] << ")";
+            Stats stats = compute_stats(samples);
+            std::cout << width << "x" << height << "	" << name.str() << "	" << stats.median << "		" << stats.p95 << std::endl;
+        }
     }
+    return EXIT_SUCCESS;
+}
 
-    //8. Load shaders
-    GLuint program = load_shaders(argv[1], argv[2]);
-    if (!program) {
-        std::cerr << "Failed to create shader program. See above for more details" << std::endl;
-        eglTerminate(display);
+int main(int argc, char** argv)
+{
+    bool use_cpu = argc >= 3 && std::string(argv[1]) == "--cpu";
+    bool use_matrix = argc >= 4 && std::string(argv[1]) == "--matrix";
+    bool use_pool = argc >= 4 && std::string(argv[1]) == "--pool";
+    bool use_stats = argc >= 4 && std::string(argv[1]) == "--stats";
+    int args = (use_matrix || use_pool || use_stats) ? argc - 1 : argc;
+    if (args < 3 || args > 5) {
+        std::cerr << "Usage: " << argv[0] << " <vertex shader path> <fragment shader path> [<warm-up iterations> [<measured iterations>]]" << std::endl
+                  << "       " << argv[0] << " --cpu <fragment shader path> [<warm-up iterations> [<measured iterations>]]" << std::endl
+                  << "       " << argv[0] << " --matrix <vertex shader path> <shader directory> [<warm-up iterations> [<measured iterations>]]" << std::endl
+                  << "       " << argv[0] << " --pool <vertex shader path> <fragment shader path> [<warm-up iterations> [<measured iterations>]]" << std::endl
+                  << "       " << argv[0] << " --stats <vertex shader path> <shader directory> [<warm-up iterations> [<measured iterations>]]" << std::endl
+                  << "--matrix sweeps the filter shaders of the directory over several sizes & transfer formats and writes bench.json" << std::endl
+                  << "--pool measures the frame rate of 1, 2, 4... GPU worker contexts (iterations are per worker)" << std::endl
+                  << "--stats compares min/max/mean & histograms computed on the GPU with a full frame readback" << std::endl;
+        return EXIT_FAILURE;
+    }
+    char** params = (use_matrix || use_pool || use_stats) ? argv + 1 : argv;
+    int warmup = args > 3 ? atoi(params[3]) : 3;
+    int iterations = args > 4 ? atoi(params[4]) : 20;
+    if (warmup < 0 || iterations < 1) {
+        std::cerr << "Error: warm-up iterations must be >= 0 & measured iterations >= 1." << std::endl;
         return EXIT_FAILURE;
     }
 
+    if (use_matrix)
+        return bench_matrix(params[1], params[2], warmup, iterations);
+    if (use_pool)
+        return bench_pool(params[1], params[2], warmup, iterations);
+    if (use_stats)
+        return bench_stats(params[1], params[2], warmup, iterations);
+
+    std::fstream csvfile;
+    csvfile.open("bench.csv", std::fstream::in | std::fstream::out | std::fstream::app);
+    if (!csvfile.is_open())
+    {
+        std::cerr << "Could not opencv bench.csv, benchmark results are not going to be saved" << std::endl;
+    }
+
+    //1. One-time setup: initialize EGL & load shaders once, they are reused for every size.
+    // The CPU backend works on 8 bits images and never touches EGL.
+    GpuFilterContext gpu;
+    CpuFilter cpu_filter_id;
+    if (use_cpu)
+    {
+        if (!cpu_filter_from_shader(argv[2], cpu_filter_id)) {
+            std::cerr << "No CPU implementation of " << argv[2] << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    else if (!gpu.init() || !gpu.load_program(argv[1], argv[2]))
+        return EXIT_FAILURE;
+
+    std::string backend = use_cpu ? std::string("cpu-") + cpu_simd_name() : std::string("gpu");
+
     //--------------- BENCH SETUP ----------------
     std::cout << std::endl
                 << "** Starting benchmark **" << std::endl
-                << "Convolution using " << argv[2] << std::endl
+                << "Convolution using " << argv[2] << " on " << backend << std::endl
+                << warmup << " warm-up & " << iterations << " measured iterations per size, times in ms per frame" << std::endl
                 << "---------------------------------------------" << std::endl
-                << "Size\t\tSize (MB)\tCTime (ms)\tTTime (ms)\tTotal (ms)\tBandwidth (MB/s)" << std::endl
-                << std::fixed << std::setprecision(3) << std::setfill('0');
+                << "Size\t\tSize (MB)\tUpload\t\tCompute\t\tReadback\tMin\t\tMedian\t\tP95\t\tP99\t\tStddev\t\tBandwidth (MB/s)" << std::endl
+                << std::fixed << std::setprecision(3);
 
+    // One row per size & stage, the header is only written to a new file so that runs can be appended.
     if (csvfile.is_open())
-        csvfile << "Size,Size (MB),Compute Time (ms),Transfer Time (ms),Total Time (ms),Bandwidth (MB/s)" << std::endl;
-
-    typedef std::chrono::high_resolution_clock Time;
-    typedef std::chrono::duration<double> fsec;
-    typedef std::chrono::milliseconds ms;
+    {
+        csvfile.seekp(0, std::ios::end);
+        if (csvfile.tellp() == 0)
+            csvfile << "Backend,Shader,Size,Size (MB),Warm-up,Iterations,Stage,Min (ms),Median (ms),P95 (ms),P99 (ms),Mean (ms),Stddev (ms)" << std::endl;
+        csvfile << std::fixed << std::setprecision(4);
+    }
     //--------------- BENCH SETUP ----------------
 
-    GLuint fbo, fbo_render_texture, image_texture;
     for (int N = 128 ; N <= 8192 ; N+=N)
     {
         int image_width = N;
         int image_height = N;
         int size = image_width * image_height * 3;
-        float* image = generate_random_image(image_width, image_height, 3);
 
-        double total_time = 0, transfer_time = 0, render_time = 0;
-        int iterations = 1;
-        for (int i = 0 ; i < iterations ; ++i)
+        //2. Per-frame cost, per-size setup is done by bench_gpu/bench_cpu outside of the timed loop.
+        Measure measure;
+        if (use_cpu)
+            bench_cpu(cpu_filter_id, image_width, image_height, warmup, iterations, measure);
+        else if (!bench_gpu(gpu, image_width, image_height, GL_FLOAT, warmup, iterations, measure))
         {
-            //--------------- BENCH TOTAL TIME ----------------
-            auto total_start = Time::now();
-
-            // 9. Draw
-            // Getting location of our uniform variables
-            GLuint texture_loc = glGetUniformLocation(program, "texture");
-            GLuint width_loc = glGetUniformLocation(program, "width");
-            GLuint height_loc = glGetUniformLocation(program, "height");
-
-
-            // Create a FBO that will allow us to do offscreen rendering
-            fbo = init_fbo((int)image_width, (int)image_height, fbo_render_texture);
-            if (!fbo)
-            {
-                eglTerminate(display);
-                return EXIT_FAILURE;
-            }
-
-            // Create texture from image data
-            glGenTextures(1, &image_texture);
-            glBindTexture(GL_TEXTURE_2D, image_texture);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-
-            //--------------- BENCH TRANSFER TIME ----------------
-            auto transfer_start = Time::now();
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image_width, image_height, 0, GL_RGB, GL_FLOAT, image);
-
-            glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-            glClearColor(0.0, 0.0, 0.0, 1.0);
-            glClear(GL_COLOR_BUFFER_BIT);
-
-            glUseProgram(program);
-
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, image_texture);
-            glUniform1i(texture_loc, 0);
-
-            glUniform1i(width_loc, image_width);
-            glUniform1i(height_loc, image_height);
-
-            //--------------- BENCH COMPUTE TIME ----------------
-            auto render_start = Time::now();
-
-            // Create fullscreen quad to trigger rasterisation (use of vertex and fragment shaders)
-            Quad q;
-            q.init();
-            q.display(program);
-
-            auto render_end = Time::now();
-            render_time += fsec(render_end - render_start).count();
-            //--------------- BENCH COMPUTE TIME ----------------
-
-            // Once rasterisation is done, data have been generated and it is now possible to transfer them back from VRAM to memory.
-            float* data = new float[image_width * image_height * 3];
-            glReadPixels(0, 0, image_width, image_height, GL_RGB, GL_FLOAT, data);
-
-            auto transfer_end = Time::now();
-            transfer_time += fsec(transfer_end - transfer_start).count();
-            //--------------- BENCH TRANSFER TIME ----------------
-
-            auto total_end = Time::now();
-            total_time += fsec(total_end - total_start).count();
-            //--------------- BENCH TOTAL TIME ----------------
-
-            // Switching back to our classic buffer with scene rendered in FBO render texture
-            glBindTexture(GL_TEXTURE_2D, 0);
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
+            std::cerr << "Failed to run the benchmark at " << image_width << "x" << image_height << std::endl;
+            return EXIT_FAILURE;
         }
+        const Stats& upload = measure.upload;
+        const Stats& compute = measure.compute;
+        const Stats& readback = measure.readback;
+        const Stats& total = measure.total;
 
-        double realsize = (size * sizeof(GL_FLOAT)) / (double)1e6;
-        double ms_transfer_time = transfer_time * 1e3 / (double)iterations;
-        double ms_render_time   = render_time   * 1e3 / (double)iterations;
-        double ms_total_time    = total_time    * 1e3 / (double)iterations;
-        double bandwidth = realsize / (ms_total_time / 1e3);
+        double realsize = (size * (use_cpu ? sizeof(unsigned char) : sizeof(GLfloat))) / (double)1e6;
+        double bandwidth = realsize / (total.median / 1e3);
 
         std::cout << image_width << " x " << image_height << "\t"
                   << realsize << "\t\t"
-                  << ms_render_time << "\t\t"
-                  << ms_transfer_time << "\t\t"
-                  << ms_total_time << "\t\t"
+                  << upload.median << "\t\t"
+                  << compute.median << "\t\t"
+                  << readback.median << "\t\t"
+                  << total.min << "\t\t"
+                  << total.median << "\t\t"
+                  << total.p95 << "\t\t"
+                  << total.p99 << "\t\t"
+                  << total.stddev << "\t\t"
                   << bandwidth << std::endl;
 
         if (csvfile.is_open())
         {
-            csvfile << image_width << "x" << image_height << ","
-                    << realsize << ","
-                    << ms_render_time << ","
-                    << ms_transfer_time << ","
-                    << ms_total_time << ","
-                    << bandwidth << std::endl;
+            const char* stages[] = {"upload", "compute", "readback", "total"};
+            const Stats* stats[] = {&upload, &compute, &readback, &total};
+            for (int s = 0 ; s < 4 ; ++s)
+            {
+                csvfile << backend << "," << argv[2] << ","
+                        << image_width << "x" << image_height << ","
+                        << realsize << ","
+                        << warmup << "," << iterations << ","
+                        << stages[s] << ","
+                        << stats[s]->min << ","
+                        << stats[s]->median << ","
+                        << stats[s]->p95 << ","
+                        << stats[s]->p99 << ","
+                        << stats[s]->mean << ","
+                        << stats[s]->stddev << std::endl;
+            }
         }
     }
 
-    //10. Clean
-    glDeleteTextures(1, &image_texture);
-    glDeleteProgram(program);
-    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
-    eglDestroySurface(display, surface);
-    eglDestroyContext(display, context);
-    eglTerminate(display);
-    delete_fbo(fbo, fbo_render_texture);
-
     if (csvfile.is_open())
         csvfile.close();
 
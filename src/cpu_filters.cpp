@@ -0,0 +1,189 @@
+#include "cpu_filters.hpp"
+#include "TileScheduler.hpp"
+#include "simd.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+using namespace simd;
+
+inline int clamp(int v, int low, int high)
+{
+    return v < low ? low : (v > high ? high : v);
+}
+
+/*
+    Weights of shader/gaussian3.frag & shader/gaussian5.frag, row by row from the top (y - radius)
+    to the bottom (y + radius). They are copied as is, including the asymmetries of gaussian5.
+*/
+const float GAUSSIAN3_KERNEL[9] = {
+    0.111018f, 0.111157f, 0.111018f,
+    0.111157f, 0.111296f, 0.111157f,
+    0.111018f, 0.111157f, 0.111018f
+};
+
+const float GAUSSIAN5_KERNEL[25] = {
+    0.031827f, 0.037541f, 0.039665f, 0.037541f, 0.031827f,
+    0.037541f, 0.044281f, 0.046787f, 0.044281f, 0.037541f,
+    0.039665f, 0.046787f, 0.049434f, 0.049434f, 0.039665f,
+    0.031827f, 0.037541f, 0.039665f, 0.037541f, 0.031827f,
+    0.037541f, 0.044281f, 0.046787f, 0.044281f, 0.037541f
+};
+
+/*
+    Square convolution of an interleaved RGB image. Channels are independent, so a row is
+    processed as a flat byte array where the horizontal neighbour of a byte is 3 bytes away.
+*/
+void convolve_rows(const float* kernel, int radius, const unsigned char* src, unsigned char* dst,
+                   int width, int height, int y_begin, int y_end)
+{
+    const int size = 2 * radius + 1;
+    const int stride = width * 3;
+    std::vector<const unsigned char*> rows(size);
+
+    for (int y = y_begin ; y < y_end ; ++y)
+    {
+        for (int k = 0 ; k < size ; ++k)
+            rows[k] = src + clamp(y + k - radius, 0, height - 1) * stride;
+        unsigned char* out = dst + y * stride;
+
+        // Interior: every horizontal neighbour is inside the row, no clamping needed.
+        int begin = 3 * radius, end = stride - 3 * radius, i = begin;
+        for ( ; i + LANES <= end ; i += LANES)
+        {
+            vfloat acc = v_set1(0.f);
+            for (int ky = 0 ; ky < size ; ++ky)
+                for (int kx = 0 ; kx < size ; ++kx)
+                    acc = v_add(acc, v_mul(v_load_u8(rows[ky] + i + 3 * (kx - radius)), v_set1(kernel[ky * size + kx])));
+            v_store_u8(out + i, acc);
+        }
+
+        // Borders & remaining bytes, with clamped horizontal neighbours.
+        for (int j = 0 ; j < stride ; ++j)
+        {
+            if (j >= begin && j < i)
+                j = i;
+            if (j >= stride)
+                break;
+            int x = j / 3, c = j % 3;
+            float acc = 0.f;
+            for (int ky = 0 ; ky < size ; ++ky)
+                for (int kx = 0 ; kx < size ; ++kx)
+                    acc += rows[ky][clamp(x + kx - radius, 0, width - 1) * 3 + c] * kernel[ky * size + kx];
+            out[j] = round_u8(acc);
+        }
+    }
+}
+
+/*
+    shader/sobel.frag: gradient of the (r + g + b) / 3 gray level, output is 1 - magnitude on every channel.
+*/
+void sobel_rows(const unsigned char* src, unsigned char* dst, int width, int height, int y_begin, int y_end)
+{
+    // Gray levels of the rows [y_begin - 1, y_end], padded by one clamped pixel on each side.
+    const int padded = width + 2;
+    const int first = y_begin - 1;
+    std::vector<float> gray((y_end - y_begin + 2) * padded);
+    for (int y = first ; y <= y_end ; ++y)
+    {
+        const unsigned char* in = src + clamp(y, 0, height - 1) * width * 3;
+        float* g = &gray[(y - first) * padded] + 1;
+        for (int x = 0 ; x < width ; ++x)
+            g[x] = (in[3 * x] + in[3 * x + 1] + in[3 * x + 2]) / 3.f;
+        g[-1] = g[0];
+        g[width] = g[width - 1];
+    }
+
+    std::vector<unsigned char> magnitude(width + LANES);
+    const vfloat two = v_set1(2.f), white = v_set1(255.f);
+    for (int y = y_begin ; y < y_end ; ++y)
+    {
+        const float* top = &gray[(y - first - 1) * padded] + 1;
+        const float* mid = top + padded;
+        const float* bot = mid + padded;
+
+        int x = 0;
+        for ( ; x + LANES <= width ; x += LANES)
+        {
+            vfloat ltop = v_load_f32(top + x - 1), ctop = v_load_f32(top + x), rtop = v_load_f32(top + x + 1);
+            vfloat left = v_load_f32(mid + x - 1),                              right = v_load_f32(mid + x + 1);
+            vfloat lbot = v_load_f32(bot + x - 1), cbot = v_load_f32(bot + x), rbot = v_load_f32(bot + x + 1);
+
+            vfloat h = v_sub(v_add(v_add(rtop, v_mul(two, right)), rbot), v_add(v_add(ltop, v_mul(two, left)), lbot));
+            vfloat v = v_sub(v_add(v_add(ltop, v_mul(two, ctop)), rtop), v_add(v_add(lbot, v_mul(two, cbot)), rbot));
+            v_store_u8(&magnitude[x], v_sub(white, v_sqrt(v_add(v_mul(h, h), v_mul(v, v)))));
+        }
+        for ( ; x < width ; ++x)
+        {
+            float h = top[x + 1] + 2.f * mid[x + 1] + bot[x + 1] - (top[x - 1] + 2.f * mid[x - 1] + bot[x - 1]);
+            float v = top[x - 1] + 2.f * top[x] + top[x + 1] - (bot[x - 1] + 2.f * bot[x] + bot[x + 1]);
+            magnitude[x] = round_u8(255.f - std::sqrt(h * h + v * v));
+        }
+
+        unsigned char* out = dst + y * width * 3;
+        for (x = 0 ; x < width ; ++x)
+            out[3 * x] = out[3 * x + 1] = out[3 * x + 2] = magnitude[x];
+    }
+}
+}
+
+bool cpu_filter_from_shader(const std::string& fragment_shader_path, CpuFilter &filter)
+{
+    size_t slash = fragment_shader_path.find_last_of('/');
+    std::string name = (slash == std::string::npos) ? fragment_shader_path : fragment_shader_path.substr(slash + 1);
+
+    if (name == "gaussian3.frag")
+        filter = CPU_GAUSSIAN3;
+    else if (name == "gaussian5.frag")
+        filter = CPU_GAUSSIAN5;
+    else if (name == "sobel.frag")
+        filter = CPU_SOBEL;
+    else
+        return false;
+    return true;
+}
+
+void cpu_filter_rows(CpuFilter filter, const unsigned char* src, unsigned char* dst,
+                     int width, int height, int y_begin, int y_end)
+{
+    switch (filter)
+    {
+    case CPU_GAUSSIAN3:
+        convolve_rows(GAUSSIAN3_KERNEL, 1, src, dst, width, height, y_begin, y_end);
+        break;
+    case CPU_GAUSSIAN5:
+        convolve_rows(GAUSSIAN5_KERNEL, 2, src, dst, width, height, y_begin, y_end);
+        break;
+    case CPU_SOBEL:
+        sobel_rows(src, dst, width, height, y_begin, y_end);
+        break;
+    }
+}
+
+int cpu_filter_radius(CpuFilter filter)
+{
+    return filter == CPU_GAUSSIAN5 ? 2 : 1;
+}
+
+const float* cpu_filter_kernel(CpuFilter filter)
+{
+    return filter == CPU_GAUSSIAN3 ? GAUSSIAN3_KERNEL : (filter == CPU_GAUSSIAN5 ? GAUSSIAN5_KERNEL : NULL);
+}
+
+void cpu_filter(CpuFilter filter, const unsigned char* src, unsigned char* dst, int width, int height)
+{
+    // Full width bands of a cache-sized number of rows, each one reading its own halo from src.
+    int rows = TileScheduler::tile_rows((size_t)width * 3 * (2 * cpu_filter_radius(filter) + 1));
+    TileScheduler::global().for_each_tile(width, height, width, rows, cpu_filter_radius(filter),
+        [&](const Tile& tile) {
+            cpu_filter_rows(filter, src, dst, width, height, tile.y, tile.y + tile.height);
+        });
+}
+
+const char* cpu_simd_name()
+{
+    return SIMD_NAME;
+}
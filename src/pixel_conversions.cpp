@@ -0,0 +1,108 @@
+#include "pixel_conversions.hpp"
+#include "TileScheduler.hpp"
+#include "simd.hpp"
+
+namespace
+{
+using namespace simd;
+
+// Samples handled by one task
+const size_t GRAIN = 1 << 16;
+
+// Pixels converted before their channels are swapped: the block is still in L1 when it is swapped
+const size_t SWAP_BLOCK = 512;
+
+void uchar_to_float_range(const unsigned char* src, float* dst, size_t begin, size_t end, float scale)
+{
+    vfloat factor = v_set1(scale);
+    size_t i = begin;
+    for ( ; i + LANES <= end ; i += LANES)
+        v_store_f32(dst + i, v_mul(v_load_u8(src + i), factor));
+    for ( ; i < end ; ++i)
+        dst[i] = src[i] * scale;
+}
+}
+
+void convert_uchar_to_float(const unsigned char* src, float* dst, size_t size, float scale)
+{
+    TileScheduler::global().parallel_for_range(size, GRAIN, [&](size_t begin, size_t end) {
+        uchar_to_float_range(src, dst, begin, end, scale);
+    });
+}
+
+void convert_float_to_uchar(const float* src, unsigned char* dst, size_t size, float scale)
+{
+    TileScheduler::global().parallel_for_range(size, GRAIN, [&](size_t begin, size_t end) {
+        vfloat factor = v_set1(scale);
+        size_t i = begin;
+        // v_store_u8 rounds & saturates
+        for ( ; i + LANES <= end ; i += LANES)
+            v_store_u8(dst + i, v_mul(v_load_f32(src + i), factor));
+        for ( ; i < end ; ++i)
+            dst[i] = round_u8(src[i] * scale);
+    });
+}
+
+void convert_bgr_to_rgb_float(const unsigned char* src, float* dst, size_t pixels, float scale)
+{
+    TileScheduler::global().parallel_for_range(pixels, GRAIN / 3, [&](size_t begin, size_t end) {
+        for (size_t block = begin ; block < end ; block += SWAP_BLOCK)
+        {
+            size_t block_end = block + SWAP_BLOCK < end ? block + SWAP_BLOCK : end;
+            //1. Vectorised conversion of the interleaved samples as they are
+            uchar_to_float_range(src, dst, 3 * block, 3 * block_end, scale);
+            //2. Swap, from the cache
+            for (size_t i = 3 * block ; i < 3 * block_end ; i += 3)
+            {
+                float blue = dst[i];
+                dst[i] = dst[i + 2];
+                dst[i + 2] = blue;
+            }
+        }
+    });
+}
+
+void convert_rgb_to_gray(const unsigned char* src, unsigned char* dst, size_t pixels)
+{
+    // Interleaved channels need byte shuffles that SSE2 lacks, these loops are left to the compiler
+    TileScheduler::global().parallel_for_range(pixels, GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin ; i < end ; ++i)
+            dst[i] = (src[3 * i] + src[3 * i + 1] + src[3 * i + 2]) / 3;
+    });
+}
+
+void convert_red_to_gray(const unsigned char* src, unsigned char* dst, size_t pixels, int channels)
+{
+    TileScheduler::global().parallel_for_range(pixels, GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin ; i < end ; ++i)
+            dst[i] = src[channels * i];
+    });
+}
+
+void convert_gray_to_rgb(const unsigned char* src, unsigned char* dst, size_t pixels)
+{
+    TileScheduler::global().parallel_for_range(pixels, GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin ; i < end ; ++i)
+        {
+            unsigned char gray = src[i];
+            dst[3 * i] = gray;
+            dst[3 * i + 1] = gray;
+            dst[3 * i + 2] = gray;
+        }
+    });
+}
+
+void convert_swap_red_blue(const unsigned char* src, unsigned char* dst, size_t pixels, int channels)
+{
+    TileScheduler::global().parallel_for_range(pixels, GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin * channels ; i < end * channels ; i += channels)
+        {
+            unsigned char red = src[i];
+            dst[i] = src[i + 2];
+            dst[i + 1] = src[i + 1];
+            dst[i + 2] = red;
+            if (channels == 4)
+                dst[i + 3] = src[i + 3];
+        }
+    });
+}
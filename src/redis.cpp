@@ -1,8 +1,15 @@
 #include <opencv2/opencv.hpp>
 #include <hiredis/hiredis.h>
 
-#include "quad.hpp"
-#include "gles_utils.hpp"
+#include <cctype>
+#include <chrono>
+#include <deque>
+#include <thread>
+
+#include "GpuFilterContext.hpp"
+#include "FramePipeline.hpp"
+#include "RedisTransport.hpp"
+#include "ShmFrameRing.hpp"
 #include <RedisImageHelper.hpp>
 #include "RedisCameraServer.hpp"
 #include "ImageUtils.hpp"
@@ -12,10 +19,314 @@ static bool isPowerOfTwo(int x)
     return (x != 0) && ((x & (x - 1)) == 0);
 }
 
+// Results SET but not acknowledged yet, beyond that the stream waits for the oldest one
+static const size_t MAX_PENDING_WRITES = 4;
+
+/**
+    Frames read in place from the shared memory ring of a RedisCameraServer, found through <camera key>:shm.
+*/
+struct SharedFrameSource
+{
+    RedisTransport metadata;
+    ShmFrameRing ring;
+    std::string key;
+    unsigned long long last;
+};
+
+/**
+    Submit a frame of a shared memory ring, uploaded straight from the ring.
+    @param name the ring name, (re)opened when it changes or grows
+    @param sequence the frame sequence in the ring
+    @param yuv true for I420 frames, stored as a single channel image of height * 3 / 2 rows
+    @param submitted set to true if the frame was submitted
+    @param intact set to false if the producer overwrote the frame during the upload
+    @param width a reference receiving the width of the picture
+    @param height a reference receiving the height of the picture
+    @return false on errors
+*/
+static bool submit_ring_frame(ShmFrameRing& ring, const char* name, unsigned long long sequence, bool yuv,
+                              FramePipeline& pipeline, bool &submitted, bool &intact, int &width, int &height)
+{
+    // The producer recreates its ring when the frame size grows
+    size_t size = (size_t)width * (yuv ? height * 3 / 2 : height * 3);
+    if ((!ring.is_open() || ring.name() != name || ring.slot_size() < size) && !ring.open(name))
+        return false;
+
+    int rows, channels;
+    const unsigned char* data = ring.frame(sequence, width, rows, channels);
+    if (data == NULL || channels != (yuv ? 1 : 3))
+        return true; // Already overwritten, wait for the next one
+    height = yuv ? rows * 2 / 3 : rows;
+    if (!(yuv ? pipeline.submit_yuv(data, width, height, YUV_I420) : pipeline.submit(data, width, height)))
+        return false;
+    submitted = true;
+    intact = ring.valid(sequence);
+    return true;
+}
+
+/**
+    Submit the latest shared memory frame, uploaded straight from the ring.
+    @param submitted set to true if a new frame was submitted
+    @param intact set to false if the producer overwrote the frame during the upload
+    @param width a reference receiving the width of the submitted frame
+    @param height a reference receiving the height of the submitted frame
+    @return false on errors
+*/
+static bool submit_shared_frame(SharedFrameSource& source, FramePipeline& pipeline, bool &submitted, bool &intact,
+                                int &width, int &height)
+{
+    submitted = false;
+    char value[512];
+    size_t size = 0;
+    if (!source.metadata.get(source.key + ":shm", value, sizeof(value) - 1, &size))
+        return false;
+    value[size] = '\0';
+
+    char name[256], format[8] = "";
+    unsigned long long sequence;
+    int channels;
+    if (sscanf(value, "%255s %llu %d %d %d %*u %*d %7s", name, &sequence, &width, &height, &channels, format) < 5) {
+        std::cerr << "Invalid shared frame metadata: " << value << std::endl;
+        return false;
+    }
+    if (sequence == source.last)
+        return true;
+    source.last = sequence;
+    return submit_ring_frame(source.ring, name, sequence, strcmp(format, "I420") == 0, pipeline, submitted, intact, width, height);
+}
+
+/**
+    Frames announced on <camera key>:frames by a RedisCameraServer (see enableFrameEvents()).
+*/
+struct FrameEvents
+{
+    RedisTransport subscription;
+    ShmFrameRing ring;
+    std::string key;            // Redis key of the last frame, the camera key of the image client
+    unsigned long long last;    // Sequence of the last event
+    long missed;                // Events lost in between, e.g. while the subscriber was too slow
+};
+
+/**
+    Wait for the next frame event & submit the frame it announces.
+    @param timeout_ms the maximum wait, -1 to block until a frame comes
+    @param submitted set to true if a new frame was submitted
+    @param intact set to false if a shared memory frame was overwritten during the upload
+    @param width a reference receiving the width of the submitted frame
+    @param height a reference receiving the height of the submitted frame
+    @return false on errors
+*/
+static bool submit_announced_frame(FrameEvents& events, RedisImageHelper& client, FramePipeline& pipeline, int timeout_ms,
+                                   bool &submitted, bool &intact, int &width, int &height)
+{
+    submitted = false;
+    std::string event;
+    if (!events.subscription.read_message(event, timeout_ms))
+        return events.subscription.connected(); // Timeout
+
+    //1. "<sequence> <key> <width> <height> <channels> [<ring sequence>]"
+    char key[256], format[8] = "";
+    unsigned long long sequence, ring_sequence = 0;
+    int channels;
+    int fields = sscanf(event.c_str(), "%llu %255s %d %d %d %llu %7s", &sequence, key, &width, &height, &channels, &ring_sequence, format);
+    if (fields < 5) {
+        std::cerr << "Invalid frame event: " << event << std::endl;
+        return false;
+    }
+
+    //2. Sequences are consecutive, a gap means events were lost (a lower one: the server restarted)
+    if (events.last != 0 && sequence > events.last + 1)
+        events.missed += sequence - events.last - 1;
+    events.last = sequence;
+
+    //3. Shared memory frame, used in place
+    if (fields >= 6)
+        return submit_ring_frame(events.ring, key, ring_sequence, strcmp(format, "I420") == 0, pipeline,
+                                 submitted, intact, width, height);
+
+    //4. Frame stored in Redis
+    if (channels != 3)
+        return true;
+    if (events.key != key)
+    {
+        events.key = key;
+        client.setCameraKey(events.key);
+    }
+    Image* frame = client.getImage();
+    if (frame == NULL)
+        return false;
+    width = frame->width();
+    height = frame->height();
+    bool submitted_ok = pipeline.submit(frame->data(), width, height);
+    delete frame;
+    submitted = submitted_ok;
+    intact = true;
+    return submitted_ok;
+}
+
+/**
+    Process frames continuously until max_frames (0: forever). Each iteration grabs a new frame,
+    submits it to the pipeline & publishes the oldest finished one, so the upload of a frame overlaps
+    the draw & readback of the previous ones.
+    Results are written raw to <camera key>:output ("<width> <height> 3" in <camera key>:output:size)
+    through a pipelined connection: the stream never waits for a SET round trip.
+    @return EXIT_SUCCESS or EXIT_FAILURE
+*/
+static int stream(GpuFilterContext& gpu, RedisImageHelper& client, RedisCameraServer* server, SharedFrameSource* shared,
+                  FrameEvents* events, const std::string& camera_key, const char* output_path, long max_frames)
+{
+    RedisTransport transport;
+    if (!transport.connect())
+        return EXIT_FAILURE;
+    std::string output_key = camera_key + ":output";
+    int published_width = 0, published_height = 0;
+
+    FramePipeline pipeline(gpu, 3);
+    std::cerr << "Streaming with " << (pipeline.asynchronous() ? "asynchronous (pixel buffer)" : "synchronous") << " readback." << std::endl;
+    std::vector<unsigned char> data;
+    int width = 0, height = 0;
+    long received = 0, dropped = 0, frames_since_report = 0;
+    std::deque<bool> intact_frames; // One per frame in flight
+    auto report_start = std::chrono::steady_clock::now();
+
+    bool idle = false; // No new camera frame last time
+    for (long submitted = 0 ; max_frames == 0 || submitted < max_frames || pipeline.in_flight() > 0 ; )
+    {
+        //1. Oldest frame done (or the pipeline full): publish it. Without readback buffers there is no
+        // way to tell that a frame is done, so it is only read back once the pipeline is full, or
+        // while waiting for the camera.
+        bool done = pipeline.asynchronous() && pipeline.ready();
+        if (done || pipeline.in_flight() == pipeline.depth() || (max_frames != 0 && submitted == max_frames)
+            || (idle && pipeline.in_flight() > 0))
+        {
+            idle = false;
+            if (!pipeline.receive(&data[0], width, height))
+                return EXIT_FAILURE;
+            bool intact = intact_frames.front();
+            intact_frames.pop_front();
+            if (!intact)
+            {
+                ++dropped;
+                continue;
+            }
+            if (width != published_width || height != published_height)
+            {
+                std::string size = std::to_string(width) + " " + std::to_string(height) + " 3";
+                transport.append_set(output_key + ":size", size.data(), size.size());
+                published_width = width;
+                published_height = height;
+            }
+            // hiredis serialises the payload right away, data can be overwritten by the next receive()
+            if (!transport.append_set(output_key, &data[0], (size_t)width * height * 3) || !transport.flush())
+                return EXIT_FAILURE;
+            while (transport.pending() > MAX_PENDING_WRITES)
+                if (!transport.read_reply())
+                    return EXIT_FAILURE;
+            ++received;
+            ++frames_since_report;
+            continue;
+        }
+
+        //2. Grab & submit the next one. With background capture this never waits for the camera,
+        // when nothing new was captured the time goes to finishing the frames in flight.
+        if (server && !server->pickUpCameraFrame())
+        {
+            if (pipeline.in_flight() == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            idle = true;
+            continue;
+        }
+        int frame_width = 0, frame_height = 0;
+        if (events)
+        {
+            // Blocks on the subscription, unless frames in flight can be finished meanwhile
+            bool new_frame = false, intact = true;
+            if (!submit_announced_frame(*events, client, pipeline, pipeline.in_flight() > 0 ? 0 : -1,
+                                        new_frame, intact, frame_width, frame_height))
+                return EXIT_FAILURE;
+            if (!new_frame)
+            {
+                idle = true;
+                continue;
+            }
+            intact_frames.push_back(intact);
+        }
+        else if (shared)
+        {
+            bool new_frame = false, intact = true;
+            if (!submit_shared_frame(*shared, pipeline, new_frame, intact, frame_width, frame_height))
+                return EXIT_FAILURE;
+            if (!new_frame)
+            {
+                idle = true;
+                continue;
+            }
+            intact_frames.push_back(intact);
+        }
+        else
+        {
+            Image* frame = client.getImage();
+            if (frame == NULL)
+                return EXIT_FAILURE;
+            frame_width = frame->width();
+            frame_height = frame->height();
+            bool submitted_ok = pipeline.submit(frame->data(), frame->width(), frame->height());
+            delete frame; // The upload copied it
+            if (!submitted_ok)
+                return EXIT_FAILURE;
+            intact_frames.push_back(true);
+        }
+        // Every frame in flight is read back into the same buffer, which only has to fit the largest one
+        if (data.size() < (size_t)frame_width * frame_height * 3)
+            data.resize((size_t)frame_width * frame_height * 3);
+        ++submitted;
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - report_start).count();
+        if (elapsed >= 1.0)
+        {
+            std::cerr << frames_since_report / elapsed << " frames/s (" << received << " frames, " << dropped << " dropped";
+            if (server)
+                std::cerr << ", " << server->droppedFrames() << " camera frames skipped";
+            if (events)
+                std::cerr << ", " << events->missed << " frame events missed";
+            std::cerr << ")" << std::endl;
+            frames_since_report = 0;
+            report_start = std::chrono::steady_clock::now();
+        }
+    }
+
+    if (!transport.drain())
+        return EXIT_FAILURE;
+
+    // Save the last image (optional)
+    if (received > 0)
+        write_ppm((char*)output_path, &data[0], width, height);
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char** argv)
 {
+    // --stream [frames] loops over new frames instead of processing a single one
+    bool streaming = argc > 1 && strcmp(argv[1], "--stream") == 0;
+    long max_frames = 0;
+    if (streaming)
+    {
+        int shift = 1;
+        if (argc > 2 && isdigit((unsigned char)argv[2][0]))
+        {
+            max_frames = atol(argv[2]);
+            shift = 2;
+        }
+        argv += shift;
+        argc -= shift;
+    }
+
     if (argc < 5) {
-        std::cerr << "Usage: " << argv[0] << " <vertex shader path> <fragment shader path> <output file> <fake|camera frame> <size>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " [--stream [<frames>]] <vertex shader path> <fragment shader path> <output file> <fake|camera|camera-shm|camera-yuv|subscribe frame> <size>" << std::endl
+                  << "--stream processes new frames until <frames> have been done (forever if omitted), publishing each result." << std::endl
+                  << "camera-shm (--stream only) hands camera frames over through shared memory, Redis only carries their location." << std::endl
+                  << "camera-yuv (--stream only) does the same with the I420 camera frames, converted to RGB on the GPU (shader/yuv_to_rgb.frag next to the fragment shader)." << std::endl
+                  << "subscribe (--stream only) processes the frames announced by a camera stream running in another process." << std::endl;
         return EXIT_FAILURE;
     }
 
@@ -23,22 +334,42 @@ int main(int argc, char** argv)
     if (!client.connect()) { std::cerr << "Error: Could not connect to the server." << std::endl; return EXIT_FAILURE; }
 
     std::string cameraKey;
+    //Get image from webcam into redis
+    RedisCameraServer server;
+    bool use_yuv = strcmp(argv[4], "camera-yuv") == 0;
+    bool use_shm = use_yuv || strcmp(argv[4], "camera-shm") == 0;
+    bool use_camera = use_shm || strcmp(argv[4], "camera") == 0;
+    bool use_events = strcmp(argv[4], "subscribe") == 0;
+    if ((use_shm || use_events) && !streaming) { std::cerr << argv[4] << " requires --stream." << std::endl; return EXIT_FAILURE; }
     //0. Prepare image texture
-    if (strcmp(argv[4], "camera") == 0)
+    if (use_camera)
     {
-        //Get image from webcam into redis
-        RedisCameraServer server;
+        // YUV frames skip both conversions of the capture, the planes go as they are to the GPU
         std::string gstCommand = "nvcamerasrc ! video/x-raw(memory:NVMM), width=(int)1280, height=(int)720, format=(string)I420, framerate=(fraction)120/1, queue-size=2, blockSize=16384, auto-exposure=1, scene-mode=1, flicker=0"
                                 "! nvvidconv flip-method=0 ! video/x-raw, format=(string)BGRx ! videoconvert ! video/x-raw, format=(string)BGR ! appsink";
+        if (use_yuv)
+            gstCommand = gstCommand.substr(0, gstCommand.find("! nvvidconv")) + "! nvvidconv flip-method=0 ! video/x-raw, format=(string)I420 ! appsink";
 
         if (!server.start(gstCommand)) { std::cerr << "Could not get webcam frame." << std::endl; return EXIT_FAILURE; }
 
         cameraKey = "custom:image";
         server.setCameraKey(cameraKey);
+        if (use_shm && !server.enableSharedMemory("/ipogles_camera")) { std::cerr << "Could not enable shared memory frames." << std::endl; return EXIT_FAILURE; }
+        if (use_yuv && !server.enableYuvFrames()) return EXIT_FAILURE;
+        // Other processes can follow the stream with the subscribe source
+        if (streaming && !server.enableFrameEvents()) { std::cerr << "Could not enable frame events." << std::endl; return EXIT_FAILURE; }
         server.pickUpCameraFrame();
+        // Streams capture on their own thread & always process the freshest frame
+        if (streaming && !server.startCapture()) { std::cerr << "Could not start the capture thread." << std::endl; return EXIT_FAILURE; }
 
         client.setCameraKey(cameraKey);
     }
+    else if (use_events)
+    {
+        // The frames come from the camera stream of another process
+        cameraKey = "custom:image";
+        client.setCameraKey(cameraKey);
+    }
     else
     {
         if (argc != 6)
@@ -49,7 +380,9 @@ int main(int argc, char** argv)
         int size = atoi(argv[5]);
         if (!isPowerOfTwo(size)) { std::cerr << "Error: Specified size must be power of 2." << std::endl; return EXIT_FAILURE; }
 
-        unsigned char* tmpdata = float_to_uchar(generate_random_image(size, size, 3), size * size * 3);
+        // Generated straight as bytes: one allocation & one pass
+        unsigned char* tmpdata = new unsigned char[size * size * 3];
+        fill_random_image(tmpdata, size, size, 3);
 
         Image* frame = new Image(size, size, 3, tmpdata);
         cameraKey = "custom:image:fake";
@@ -57,6 +390,36 @@ int main(int argc, char** argv)
         client.setImage(frame);
     }
 
+    if (streaming)
+    {
+        GpuFilterContext gpu;
+        if (!gpu.init() || !gpu.load_program(argv[1], argv[2]))
+            return EXIT_FAILURE;
+        // Shared memory & announced frames may be I420, converted by a shader of the same directory
+        std::string fragment_path = argv[2];
+        size_t slash = fragment_path.rfind('/');
+        std::string yuv_path = (slash == std::string::npos ? std::string(".") : fragment_path.substr(0, slash)) + "/yuv_to_rgb.frag";
+        if ((use_shm || use_events) && !gpu.load_yuv_program(argv[1], yuv_path))
+        {
+            if (use_yuv)
+                return EXIT_FAILURE;
+            std::cerr << "Warning: no YUV conversion, I420 frames cannot be processed." << std::endl;
+        }
+        SharedFrameSource shared;
+        shared.key = cameraKey;
+        shared.last = 0;
+        if (use_shm && !shared.metadata.connect())
+            return EXIT_FAILURE;
+        FrameEvents events;
+        events.key = cameraKey;
+        events.last = 0;
+        events.missed = 0;
+        if (use_events && (!events.subscription.connect() || !events.subscription.subscribe(cameraKey + ":frames")))
+            return EXIT_FAILURE;
+        return stream(gpu, client, use_camera ? &server : NULL, use_shm ? &shared : NULL, use_events ? &events : NULL,
+                      cameraKey, argv[3], max_frames);
+    }
+
     // Get camera frame from redis
     Image* frame = client.getImage();
     if (frame == NULL)
@@ -66,146 +429,19 @@ int main(int argc, char** argv)
     int image_width = frame->width(), image_height = frame->height();
     unsigned char* image = frame->data();
 
-    //1. Get a EGL valid display
-    EGLDisplay display;
-    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
-    if (display == EGL_NO_DISPLAY) {
-        std::cerr << "Failed to get EGL Display" << std::endl
-            << "Error: " << eglGetError() << std::endl;
-        return EXIT_FAILURE;
-    }
-    else {
-        std::cerr << "Successfully get EGL Display." << std::endl;
-    }
-
-
-    //2. Initialize EGL. Create a connection to the display.
-    int minor, major;
-    if (eglInitialize(display, &minor, &major) == EGL_FALSE) {
-        std::cerr << "Failed to initialize EGL Display" << std::endl
-            << "Error: " << eglGetError() << std::endl;
-        eglTerminate(display);
-        return EXIT_FAILURE;
-    }
-    else {
-        std::cerr << "Successfully intialized display (OpenGL ES version " << minor << "." << major << ")." << std::endl;
-    }
-
-    //3. Find a config that match specified requirements (in gles_utils.hpp).
-    // OpenGL ES Config are used to specify things like multi sampling, channel size, stencil buffer usage, & more
-    // See the doc: https://www.khronos.org/registry/EGL/sdk/docs/man/html/eglChooseConfig.xhtml for more informations
-    EGLConfig config;
-    EGLint num_configs;
-    if (!eglChooseConfig(display, EGL_CONFIG_ATTRIBUTES, &config, 1, &num_configs)) {
-        std::cerr << "Failed to choose EGL Config" << std::endl
-            << "Error: " << eglGetError() << std::endl;
-        eglTerminate(display);
-        return EXIT_FAILURE;
-    }
-    else {
-        std::cerr << "Successfully choose OpenGL ES Config ("<< num_configs << ")." << std::endl;
-    }
-
-    //4. Creating an OpenGL Render Surface with surface attributes defined above to draw to.
-    EGLint pbufferAttributes[] = {EGL_WIDTH, image_width, EGL_HEIGHT, image_height, EGL_NONE};
-    EGLSurface surface = eglCreatePbufferSurface(display, config, pbufferAttributes);
-    if (surface == EGL_NO_SURFACE) {
-        std::cerr << "Failed to create EGL Surface." << std::endl
-            << "Error: " << eglGetError() << std::endl;
-    }
-    else {
-        std::cerr << "Successfully created OpenGL ES Surface." << std::endl;
-    }
-
-    //5. Make OpenGL ES the current API.
-    eglBindAPI(EGL_OPENGL_API);
-
-    //6. Create a context.
-    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
-    if (context == EGL_NO_CONTEXT) {
-        std::cerr << "Failed to create EGL Context." << std::endl
-            << "Error: " << eglGetError() << std::endl;
-    }
-    else {
-        std::cerr << "Successfully created OpenGL ES Context." << std::endl;
-    }
-
-    //7. Bind context to to the current thread.
-    bool result = eglMakeCurrent(display, surface, surface, context);
-    if (!result) {
-        std::cerr << "Failed to make the egl context to the current one." << std::endl;
-        eglTerminate(display);
+    //1. Initialize EGL & load shaders
+    GpuFilterContext gpu;
+    if (!gpu.init() || !gpu.load_program(argv[1], argv[2]))
         return EXIT_FAILURE;
-    }
-
-    //8. Load shaders
-    GLuint program = load_shaders(argv[1], argv[2]);
-    if (!program) {
-        std::cerr << "Failed to create shader program. See above for more details" << std::endl;
-        eglTerminate(display);
-        return EXIT_FAILURE;
-    }
-
-    // 9. Draw
-    // Getting location of our uniform variables
-    GLuint texture_loc = glGetUniformLocation(program, "texture");
-    GLuint width_loc = glGetUniformLocation(program, "width");
-    GLuint height_loc = glGetUniformLocation(program, "height");
 
-    // Create a FBO that will allow us to do offscreen rendering
-    GLuint fbo_render_texture;
-    GLuint fbo = init_fbo((int)image_width, (int)image_height, fbo_render_texture);
-    if (!fbo)
-    {
-        eglTerminate(display);
-        return EXIT_FAILURE;
-    }
-
-    // Create texture from image data
-    GLuint image_texture;
-    glGenTextures(1, &image_texture);
-    glBindTexture(GL_TEXTURE_2D, image_texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image_width, image_height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-    glClearColor(0.0, 0.0, 0.0, 1.0);
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    glUseProgram(program);
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, image_texture);
-    glUniform1i(texture_loc, 0);
-
-    glUniform1i(width_loc, image_width);
-    glUniform1i(height_loc, image_height);
-
-    // Create fullscreen quad to trigger rasterisation (use of vertex and fragment shaders)
-    Quad q;
-    q.init();
-    q.display(program);
-
-    // Once rasterisation is done, data have been generated and it is now possible to transfer them back from VRAM to memory.
+    //2. Draw & read back
     unsigned char* data = new unsigned char[image_width * image_height * 3];
-    glReadPixels(0, 0, image_width, image_height, GL_RGB, GL_UNSIGNED_BYTE, data);
-
-    // Switching back to our classic buffer with scene rendered in FBO render texture
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!gpu.process(image, data, image_width, image_height))
+        return EXIT_FAILURE;
 
     // Save image (optional)
     client.setImage(new Image(image_width, image_height, 3, data), true);
     write_ppm(argv[3], data, image_width, image_height);
 
-    //10. Clean
-    glDeleteTextures(1, &image_texture);
-    glDeleteProgram(program);
-    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
-    eglDestroySurface(display, surface);
-    eglDestroyContext(display, context);
-    eglTerminate(display);
-    delete_fbo(fbo, fbo_render_texture);
-
     return EXIT_SUCCESS;
 }